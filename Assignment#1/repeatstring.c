@@ -4,25 +4,500 @@ Homework#1
 Redon Jashari
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
 #include <limits.h>
+#include <getopt.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
-//buffering modes
-enum bufmode { MODE_DEFAULT = 0, MODE_UNBUF, MODE_LINE, MODE_FULL };
+//buffering modes (MODE_BLOCK/MODE_ZEROCOPY bypass stdio and write replicated blocks)
+enum bufmode { MODE_DEFAULT = 0, MODE_UNBUF, MODE_LINE, MODE_FULL, MODE_BLOCK, MODE_ZEROCOPY };
 
-//parse positive integer from string; returns -1 on error
+#define BLOCK_DEFAULT (1L << 20) // default block size for -B/-z (1 MiB)
+#define IOV_BATCH     64         // block copies handed to one writev()
+#define SWEEP_MAX     (1L << 20) // largest -b size tried by --sweep
+
+//accounting for --stats: syscalls issued on the stdout fd and bytes they moved
+static struct {
+    unsigned long long calls;
+    unsigned long long bytes;
+} iostat;
+
+//parse positive integer from string, optional K/M/G suffix; returns -1 on error
 static long parse_size(const char *s) {
     char *end;
     errno = 0;
     long val = strtol(s, &end, 10);
-    if (errno != 0 || end == s || *end != '\0' || val <= 0) {
+    if (errno != 0 || end == s || val <= 0) {
+        return -1;
+    }
+    long mult = 1;
+    switch (*end) {
+        case '\0': break;
+        case 'k': case 'K': mult = 1L << 10; end++; break;
+        case 'm': case 'M': mult = 1L << 20; end++; break;
+        case 'g': case 'G': mult = 1L << 30; end++; break;
+        default: return -1;
+    }
+    if (*end != '\0' || val > LONG_MAX / mult) {
+        return -1;
+    }
+    return val * mult;
+}
+
+static double timespec_to_double(const struct timespec *t) {
+    return (double)t->tv_sec + (double)t->tv_nsec / 1e9;
+}
+
+//fopencookie write hook: each write() here is one the plain stdout stream would make
+static ssize_t count_write(void *cookie, const char *buf, size_t size) {
+    int fd = *(int *)cookie;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t w = write(fd, buf + done, size - done);
+        iostat.calls++;
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return done > 0 ? (ssize_t)done : -1;
+        }
+        iostat.bytes += (size_t)w;
+        done += (size_t)w;
+    }
+    return (ssize_t)done;
+}
+
+//stdio stream on the stdout fd whose flushes are counted in iostat
+static FILE *counting_stdout(void) {
+    static int fd = STDOUT_FILENO;
+    cookie_io_functions_t fns = { .write = count_write };
+    return fopencookie(&fd, "w", fns);
+}
+
+//format the joined line once: words separated by ' ', optional trailing '\n'
+static char *build_line(int argc, char *argv[], int first, int no_newline, size_t *lenp) {
+    size_t len = 0;
+    for (int j = first; j < argc; ++j) {
+        if (j > first) len++;
+        len += strlen(argv[j]);
+    }
+    if (!no_newline) len++;
+
+    char *line = malloc(len + 1);
+    if (line == NULL) {
+        return NULL;
+    }
+    char *p = line;
+    for (int j = first; j < argc; ++j) {
+        if (j > first) *p++ = ' ';
+        size_t n = strlen(argv[j]);
+        memcpy(p, argv[j], n);
+        p += n;
+    }
+    if (!no_newline) *p++ = '\n';
+    *p = '\0';
+
+    *lenp = len;
+    return line;
+}
+
+//fill blk (cap bytes, a multiple of len) with copies of line by doubling
+static void replicate(char *blk, size_t cap, const char *line, size_t len) {
+    size_t filled = len;
+    memcpy(blk, line, len);
+    while (filled < cap) {
+        size_t n = (filled < cap - filled) ? filled : cap - filled;
+        memcpy(blk + filled, blk, n);
+        filled += n;
+    }
+}
+
+//drop w transferred bytes from the front of an iovec array
+static void advance_iov(struct iovec **iovp, int *cntp, size_t w) {
+    struct iovec *iov = *iovp;
+    int cnt = *cntp;
+    while (cnt > 0 && w >= iov->iov_len) {
+        w -= iov->iov_len;
+        iov++;
+        cnt--;
+    }
+    if (cnt > 0) {
+        iov->iov_base = (char *)iov->iov_base + w;
+        iov->iov_len -= w;
+    }
+    *iovp = iov;
+    *cntp = cnt;
+}
+
+//writev the whole iovec array, resuming after short writes; returns -1 on error
+static int write_iov_all(int fd, struct iovec *iov, int cnt) {
+    while (cnt > 0) {
+        ssize_t w = writev(fd, iov, cnt);
+        iostat.calls++;
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        iostat.bytes += (size_t)w;
+        advance_iov(&iov, &cnt, (size_t)w);
+    }
+    return 0;
+}
+
+//hand the iovec pages to a pipe without copying; falls back to writev if refused
+static int vmsplice_all(int fd, struct iovec *iov, int cnt) {
+    while (cnt > 0) {
+        ssize_t w = vmsplice(fd, iov, (unsigned long)cnt, 0);
+        iostat.calls++;
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EINVAL || errno == ENOSYS) {
+                return write_iov_all(fd, iov, cnt);
+            }
+            return -1;
+        }
+        iostat.bytes += (size_t)w;
+        advance_iov(&iov, &cnt, (size_t)w);
+    }
+    return 0;
+}
+
+//page-aligned block holding whole copies of line, about blocksize bytes
+//(mmap'd so pages handed to a pipe stay valid after munmap)
+static char *make_block(const char *line, size_t len, long repeat, long blocksize,
+                        size_t *perp, size_t *capp) {
+    //lines per block, never more than we need and never zero
+    size_t per = (size_t)blocksize / len;
+    if (per == 0) per = 1;
+    if (per > (size_t)repeat) per = (size_t)repeat;
+    size_t cap = per * len;
+
+    char *blk = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (blk == MAP_FAILED) {
+        fprintf(stderr, "mmap failed for block of size %zu: %s\n", cap, strerror(errno));
+        return NULL;
+    }
+    replicate(blk, cap, line, len);
+
+    *perp = per;
+    *capp = cap;
+    return blk;
+}
+
+//emit nlines lines from a block of per lines, IOV_BATCH block copies per call
+static int put_lines(int fd, const char *blk, size_t per, size_t len, size_t nlines,
+                     int (*put)(int, struct iovec *, int)) {
+    struct iovec iov[IOV_BATCH];
+    size_t full = nlines / per;
+    size_t rest = (nlines % per) * len;
+
+    while (full > 0) {
+        int cnt = full < IOV_BATCH ? (int)full : IOV_BATCH;
+        for (int i = 0; i < cnt; ++i) {
+            iov[i].iov_base = (void *)blk;
+            iov[i].iov_len = per * len;
+        }
+        if (put(fd, iov, cnt) < 0) {
+            return -1;
+        }
+        full -= (size_t)cnt;
+    }
+    if (rest > 0) {
+        iov[0].iov_base = (void *)blk;
+        iov[0].iov_len = rest;
+        if (put(fd, iov, 1) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+//block engine: replicate the line into one aligned block and write copies of it
+static int block_output(const char *line, size_t len, long repeat, long blocksize) {
+    if (len == 0 || repeat <= 0) {
+        return 0;
+    }
+
+    size_t per, cap;
+    char *blk = make_block(line, len, repeat, blocksize, &per, &cap);
+    if (blk == NULL) {
+        return -1;
+    }
+    int rc = put_lines(STDOUT_FILENO, blk, per, len, (size_t)repeat, write_iov_all);
+    if (rc < 0) {
+        fprintf(stderr, "writev failed: %s\n", strerror(errno));
+    }
+    munmap(blk, cap);
+    return rc;
+}
+
+//pipe: grow the pipe to the block size, then vmsplice the same pages repeatedly
+static int pipe_output(const char *line, size_t len, long repeat, long blocksize) {
+    int psz = fcntl(STDOUT_FILENO, F_SETPIPE_SZ, (int)blocksize);
+    if (psz < 0) {
+        //over /proc/sys/fs/pipe-max-size without privilege; keep the current size
+        psz = fcntl(STDOUT_FILENO, F_GETPIPE_SZ);
+    }
+    if (psz > 0 && psz < blocksize) blocksize = psz;
+
+    size_t per, cap;
+    char *blk = make_block(line, len, repeat, blocksize, &per, &cap);
+    if (blk == NULL) {
+        return -1;
+    }
+    int rc = put_lines(STDOUT_FILENO, blk, per, len, (size_t)repeat, vmsplice_all);
+    if (rc < 0) {
+        fprintf(stderr, "vmsplice failed: %s\n", strerror(errno));
+    }
+    //the pipe holds its own page references, so unmapping does not corrupt unread data
+    munmap(blk, cap);
+    return rc;
+}
+
+//regular file: write one block, then double the file contents in-kernel with copy_file_range
+static int file_output(const char *line, size_t len, long repeat, long blocksize) {
+    int flags = fcntl(STDOUT_FILENO, F_GETFL);
+    off_t base = lseek(STDOUT_FILENO, 0, SEEK_CUR);
+    if (flags < 0 || (flags & O_APPEND) || base < 0) {
+        return block_output(line, len, repeat, blocksize);
+    }
+    //stdout is usually write-only; copy_file_range needs a readable source fd
+    int rfd = open("/proc/self/fd/1", O_RDONLY | O_CLOEXEC);
+    if (rfd < 0) {
+        return block_output(line, len, repeat, blocksize);
+    }
+
+    size_t per, cap;
+    char *blk = make_block(line, len, repeat, blocksize, &per, &cap);
+    if (blk == NULL) {
+        close(rfd);
+        return -1;
+    }
+
+    int rc = 0;
+    size_t total = len * (size_t)repeat;
+    size_t done = 0;
+    if (put_lines(STDOUT_FILENO, blk, per, len, per, write_iov_all) < 0) {
+        fprintf(stderr, "writev failed: %s\n", strerror(errno));
+        rc = -1;
+        goto out;
+    }
+    done = cap;
+
+    //copy [base, base+n) to [base+done, ...): both ends stay on line boundaries
+    while (done < total) {
+        size_t n = done < total - done ? done : total - done;
+        loff_t in = base;
+        loff_t to = base + (off_t)done;
+        size_t left = n;
+        while (left > 0) {
+            ssize_t c = copy_file_range(rfd, &in, STDOUT_FILENO, &to, left, 0);
+            iostat.calls++;
+            if (c < 0 && errno == EINTR) continue;
+            if (c <= 0) break;
+            iostat.bytes += (size_t)c;
+            left -= (size_t)c;
+        }
+        if (left > 0) {
+            //unsupported here (EXDEV, ENOSYS, ...): finish the copy with writes
+            break;
+        }
+        done += n;
+    }
+
+    //explicit offsets leave the file position alone; move it past what is in place
+    if (lseek(STDOUT_FILENO, base + (off_t)done, SEEK_SET) < 0) {
+        fprintf(stderr, "lseek failed: %s\n", strerror(errno));
+        rc = -1;
+        goto out;
+    }
+    if (done < total &&
+        put_lines(STDOUT_FILENO, blk, per, len, (total - done) / len, write_iov_all) < 0) {
+        fprintf(stderr, "writev failed: %s\n", strerror(errno));
+        rc = -1;
+    }
+
+out:
+    munmap(blk, cap);
+    close(rfd);
+    return rc;
+}
+
+//zero-copy engine: picks the transfer by what stdout is, block engine otherwise
+static int zerocopy_output(const char *line, size_t len, long repeat, long blocksize) {
+    struct stat st;
+    if (len == 0 || repeat <= 0) {
+        return 0;
+    }
+    if (fstat(STDOUT_FILENO, &st) == 0) {
+        if (S_ISFIFO(st.st_mode)) {
+            return pipe_output(line, len, repeat, blocksize);
+        }
+        if (S_ISREG(st.st_mode)) {
+            return file_output(line, len, repeat, blocksize);
+        }
+    }
+    return block_output(line, len, repeat, blocksize);
+}
+
+//apply buffering choice to out BEFORE any output; *bufp gets the malloc'd buffer
+static int apply_bufmode(FILE *out, enum bufmode mode, long bufsize, char **bufp) {
+    char *buf = NULL;
+    if (mode == MODE_UNBUF) {
+        if (setvbuf(out, NULL, _IONBF, 0) != 0) {
+            fprintf(stderr, "setvbuf(_IONBF) failed: %s\n", strerror(errno));
+            // not fatal — continue
+        }
+    } else if (mode == MODE_LINE) {
+        if (bufsize <= 0) bufsize = BUFSIZ;
+        buf = malloc((size_t)bufsize);
+        if (buf == NULL) {
+            fprintf(stderr, "malloc failed for line buffer of size %ld\n", bufsize);
+            return -1;
+        }
+        if (setvbuf(out, buf, _IOLBF, (size_t)bufsize) != 0) {
+            fprintf(stderr, "setvbuf(_IOLBF) failed: %s\n", strerror(errno));
+            //we don't free buf here because stdio may use it
+        }
+    } else if (mode == MODE_FULL) {
+        if (bufsize <= 0) bufsize = BUFSIZ;
+        buf = malloc((size_t)bufsize);
+        if (buf == NULL) {
+            fprintf(stderr, "malloc failed for full buffer of size %ld\n", bufsize);
+            return -1;
+        }
+        if (setvbuf(out, buf, _IOFBF, (size_t)bufsize) != 0) {
+            fprintf(stderr, "setvbuf(_IOFBF) failed: %s\n", strerror(errno));
+        }
+    }
+    *bufp = buf;
+    return 0;
+}
+
+// Main printing loop (same behavior as original)
+static void stdio_output(FILE *out, int argc, char *argv[], int first, int repeat, int no_newline) {
+    for (int i = 0; i < repeat; ++i) {
+        int first_word = 1;
+        for (int j = first; j < argc; ++j) {
+            if (!first_word) {
+                putc(' ', out);
+            }
+            first_word = 0;
+            char *word = argv[j];
+            for (char *p = word; *p != '\0'; ++p) {
+                putc(*p, out);
+            }
+        }
+        if (!no_newline) {
+            putc('\n', out);
+        }
+    }
+}
+
+//produce the whole output in one mode; counted routes stdio through counting_stdout()
+static int run_mode(enum bufmode mode, long bufsize, int argc, char *argv[], int first,
+                    int repeat, int no_newline, int counted) {
+    //block engines: format once, replicate, hand over in a few big transfers
+    if (mode == MODE_BLOCK || mode == MODE_ZEROCOPY) {
+        size_t len;
+        char *line = build_line(argc, argv, first, no_newline, &len);
+        if (line == NULL) {
+            fprintf(stderr, "malloc failed for line\n");
+            return -1;
+        }
+        long bs = bufsize > 0 ? bufsize : BLOCK_DEFAULT;
+        int rc = (mode == MODE_ZEROCOPY) ? zerocopy_output(line, len, repeat, bs)
+                                         : block_output(line, len, repeat, bs);
+        free(line);
+        return rc;
+    }
+
+    //a cookie stream defaults to full buffering of BUFSIZ, like stdout on a file
+    FILE *out = stdout;
+    if (counted && (out = counting_stdout()) == NULL) {
+        fprintf(stderr, "fopencookie failed: %s\n", strerror(errno));
         return -1;
     }
-    return val;
+    //...but stdout on a terminal is line buffered, so count what that would do
+    if (counted && mode == MODE_DEFAULT && isatty(STDOUT_FILENO)) {
+        if (setvbuf(out, NULL, _IOLBF, BUFSIZ) != 0) {
+            fprintf(stderr, "setvbuf(_IOLBF) failed: %s\n", strerror(errno));
+        }
+    }
+    char *buf = NULL;
+    if (apply_bufmode(out, mode, bufsize, &buf) < 0) {
+        if (counted) fclose(out);
+        return -1;
+    }
+    stdio_output(out, argc, argv, first, repeat, no_newline);
+    if (!counted) {
+        //stdout keeps using buf until exit
+        return 0;
+    }
+    int rc = fclose(out) == 0 ? 0 : -1;
+    free(buf);
+    return rc;
+}
+
+static const char *mode_name(enum bufmode mode) {
+    switch (mode) {
+        case MODE_UNBUF:    return "unbuf";
+        case MODE_LINE:     return "line";
+        case MODE_FULL:     return "full";
+        case MODE_BLOCK:    return "block";
+        case MODE_ZEROCOPY: return "zerocopy";
+        default:            return "default";
+    }
+}
+
+//run one mode with iostat reset; returns wall time in seconds, -1 on error
+static double timed_run(enum bufmode mode, long bufsize, int argc, char *argv[], int first,
+                        int repeat, int no_newline) {
+    struct timespec t0, t1;
+    iostat.calls = iostat.bytes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int rc = run_mode(mode, bufsize, argc, argv, first, repeat, no_newline, 1);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (rc < 0) {
+        return -1.0;
+    }
+    return timespec_to_double(&t1) - timespec_to_double(&t0);
+}
+
+static double mb_per_sec(double secs) {
+    return secs > 0.0 ? (double)iostat.bytes / 1e6 / secs : 0.0;
+}
+
+//--sweep: every -b size from 1 to SWEEP_MAX in powers of two, plus the other modes
+static int sweep(int argc, char *argv[], int first, int repeat, int no_newline) {
+    fprintf(stderr, "%-9s %9s %14s %12s %10s %10s\n",
+            "mode", "bufsize", "bytes", "writes", "seconds", "MB/s");
+
+    struct { enum bufmode mode; long size; } extra[] = {
+        { MODE_UNBUF, 0 }, { MODE_BLOCK, BLOCK_DEFAULT }, { MODE_ZEROCOPY, BLOCK_DEFAULT },
+    };
+    int nextra = (int)(sizeof(extra) / sizeof(extra[0]));
+    int nfull = 0;
+    for (long sz = 1; sz <= SWEEP_MAX; sz <<= 1) nfull++;
+
+    for (int k = 0; k < nfull + nextra; ++k) {
+        enum bufmode mode = k < nfull ? MODE_FULL : extra[k - nfull].mode;
+        long size = k < nfull ? 1L << k : extra[k - nfull].size;
+        double secs = timed_run(mode, size, argc, argv, first, repeat, no_newline);
+        if (secs < 0.0) {
+            return -1;
+        }
+        fprintf(stderr, "%-9s %9ld %14llu %12llu %10.6f %10.2f\n",
+                mode_name(mode), size, iostat.bytes, iostat.calls, secs, mb_per_sec(secs));
+    }
+    return 0;
 }
 
 int main(int argc, char *argv[]) {
@@ -32,9 +507,16 @@ int main(int argc, char *argv[]) {
 
     enum bufmode mode = MODE_DEFAULT;
     long bufsize = 0;
-    char *buf = NULL; //allocated buffer for setvbuf (if needed)
+    int stats = 0;
+    int do_sweep = 0;
 
-    while ((opt = getopt(argc, argv, "r:nub:l:")) != -1) {
+    static const struct option longopts[] = {
+        { "stats", no_argument, NULL, 'S' },
+        { "sweep", no_argument, NULL, 'W' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "r:nub:l:B:z:", longopts, NULL)) != -1) {
         switch (opt) {
             case 'r':
                 repeat = atoi(optarg);
@@ -67,57 +549,50 @@ int main(int argc, char *argv[]) {
                 bufsize = v;
                 break;
             }
+            case 'B': {
+                long v = parse_size(optarg);
+                if (v < 0) {
+                    fprintf(stderr, "invalid block size for -B: %s\n", optarg);
+                    return 1;
+                }
+                mode = MODE_BLOCK;   // block-replicated, bypasses stdio
+                bufsize = v;
+                break;
+            }
+            case 'z': {
+                long v = parse_size(optarg);
+                if (v < 0) {
+                    fprintf(stderr, "invalid block size for -z: %s\n", optarg);
+                    return 1;
+                }
+                mode = MODE_ZEROCOPY; // vmsplice/copy_file_range, -B otherwise
+                bufsize = v;
+                break;
+            }
+            case 'S':
+                stats = 1;           // report cost of the chosen mode on stderr
+                break;
+            case 'W':
+                do_sweep = 1;        // time every buffer size, table on stderr
+                break;
             default:
                 break;
         }
     }
 
-    //apply buffering choice BEFORE any output to stdout */
-    if (mode == MODE_UNBUF) {
-        if (setvbuf(stdout, NULL, _IONBF, 0) != 0) {
-            fprintf(stderr, "setvbuf(_IONBF) failed: %s\n", strerror(errno));
-            // not fatal — continue
-        }
-    } else if (mode == MODE_LINE) {
-        if (bufsize <= 0) bufsize = BUFSIZ;
-        buf = malloc((size_t)bufsize);
-        if (buf == NULL) {
-            fprintf(stderr, "malloc failed for line buffer of size %ld\n", bufsize);
-            return 1;
-        }
-        if (setvbuf(stdout, buf, _IOLBF, (size_t)bufsize) != 0) {
-            fprintf(stderr, "setvbuf(_IOLBF) failed: %s\n", strerror(errno));
-            //we don't free buf here because stdio may use it
-        }
-    } else if (mode == MODE_FULL) {
-        if (bufsize <= 0) bufsize = BUFSIZ;
-        buf = malloc((size_t)bufsize);
-        if (buf == NULL) {
-            fprintf(stderr, "malloc failed for full buffer of size %ld\n", bufsize);
-            return 1;
-        }
-        if (setvbuf(stdout, buf, _IOFBF, (size_t)bufsize) != 0) {
-            fprintf(stderr, "setvbuf(_IOFBF) failed: %s\n", strerror(errno));
-        }
+    if (do_sweep) {
+        return sweep(argc, argv, optind, repeat, no_newline) < 0 ? 1 : 0;
     }
 
-    // Main printing loop (same behavior as original)
-    for (int i = 0; i < repeat; ++i) {
-        int first_word = 1;
-        for (int j = optind; j < argc; ++j) {
-            if (!first_word) {
-                putchar(' ');
-            }
-            first_word = 0;
-            char *word = argv[j];
-            for (char *p = word; *p != '\0'; ++p) {
-                putchar(*p);
-            }
-        }
-        if (!no_newline) {
-            putchar('\n');
+    if (stats) {
+        double secs = timed_run(mode, bufsize, argc, argv, optind, repeat, no_newline);
+        if (secs < 0.0) {
+            return 1;
         }
+        fprintf(stderr, "mode: %s bytes: %llu writes: %llu time: %.6f s throughput: %.2f MB/s\n",
+                mode_name(mode), iostat.bytes, iostat.calls, secs, mb_per_sec(secs));
+        return 0;
     }
 
-    return 0;
+    return run_mode(mode, bufsize, argc, argv, optind, repeat, no_newline, 0) < 0 ? 1 : 0;
 }
@@ -5,7 +5,7 @@ Operating Systems
 Redon Jashari
 */
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -15,20 +15,1280 @@ Redon Jashari
 #include <errno.h>
 #include <string.h>
 #include <limits.h>
+#include <stdint.h>
+#include <math.h>
+#include <getopt.h>
+#include <sched.h>
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/personality.h>
+#include <linux/perf_event.h>
 
+#define CLONE_STACK_SIZE (64 * 1024) // stack for the clone(CLONE_VM|CLONE_VFORK) child
+#define ADAPTIVE_MIN_RUNS 10         // samples before the -e rule may stop
+#define ADAPTIVE_CAP      300.0      // default hard cap in seconds for -e
+#define REGRESS_THRESHOLD 5.0        // default --threshold in percent
+
+/* Latency histogram in nanoseconds, HDR style: values below 2^HIST_SUB_BITS get
+   their own bucket, above that every power of two is split into HIST_HALF
+   linear buckets, so a bucket is never wider than 1/64 of its value. */
+#define HIST_SUB_BITS 7
+#define HIST_HALF     (1u << (HIST_SUB_BITS - 1))
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 2) * HIST_HALF)
+
+extern char **environ;
+
+//hardware counters attached to the children with -P
+#define PERF_COUNTERS 4
+static const struct {
+    uint64_t config;
+    const char *name;
+} perf_defs[PERF_COUNTERS] = {
+    { PERF_COUNT_HW_CPU_CYCLES,       "cycles" },
+    { PERF_COUNT_HW_INSTRUCTIONS,     "instructions" },
+    { PERF_COUNT_HW_CACHE_MISSES,     "cache-misses" },
+    { PERF_COUNT_HW_BRANCH_MISSES,    "branch-misses" },
+};
+
+//how each run is started
+enum launcher { LAUNCH_FORK = 0, LAUNCH_VFORK, LAUNCH_SPAWN, LAUNCH_CLONE };
+
+static const char *launcher_names[] = { "fork", "vfork", "spawn", "clone" };
+
+//what the vfork/clone child shares with the parent
+struct child_ctx {
+    char **argv;
+    volatile int exec_err; //set by the child when execvp fails
+};
+
+//streaming sample statistics; memory does not depend on the number of samples
+struct stats {
+    uint64_t count;
+    double mean;   //Welford running mean (seconds)
+    double m2;     //Welford sum of squared deviations from the mean
+    double min;
+    double max;
+    double total;
+    uint64_t hist[HIST_BUCKETS];
+};
+
+static unsigned hist_index(uint64_t v) {
+    if (v < 2 * HIST_HALF) return (unsigned)v;
+    int shift = (63 - __builtin_clzll(v)) - (HIST_SUB_BITS - 1);
+    return (unsigned)shift * HIST_HALF + (unsigned)(v >> shift);
+}
+
+//midpoint of a bucket in nanoseconds
+static double hist_value(unsigned idx) {
+    if (idx < 2 * HIST_HALF) return (double)idx;
+    unsigned shift = idx / HIST_HALF - 1;
+    uint64_t top = idx % HIST_HALF + HIST_HALF;
+    uint64_t low = top << shift;
+    return (double)low + (double)((1ULL << shift) - 1) / 2.0;
+}
+
+static void stats_init(struct stats *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+static void stats_add(struct stats *s, double secs) {
+    if (s->count == 0 || secs < s->min) s->min = secs;
+    if (s->count == 0 || secs > s->max) s->max = secs;
+    s->total += secs;
+
+    //Welford: numerically stable single-pass mean and variance
+    s->count++;
+    double delta = secs - s->mean;
+    s->mean += delta / (double)s->count;
+    s->m2 += delta * (secs - s->mean);
+
+    double ns = secs * 1e9;
+    s->hist[hist_index(ns > 0.0 ? (uint64_t)llround(ns) : 0)]++;
+}
+
+static double stats_stddev(const struct stats *s) {
+    return s->count > 1 ? sqrt(s->m2 / (double)(s->count - 1)) : 0.0;
+}
+
+//half-width of the 95% confidence interval of the mean (Student t below 30 samples)
+static double stats_ci95(const struct stats *s) {
+    static const double t975[] = {
+        0.0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+    if (s->count < 2) return 0.0;
+    uint64_t df = s->count - 1;
+    double t = df < sizeof(t975) / sizeof(t975[0]) ? t975[df] : 1.960;
+    return t * stats_stddev(s) / sqrt((double)s->count);
+}
+
+//q-th quantile (0..1) in seconds, accurate to the bucket width, clamped to [min,max]
+static double stats_percentile(const struct stats *s, double q) {
+    if (s->count == 0) return 0.0;
+    uint64_t rank = (uint64_t)ceil(q * (double)s->count);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; ++i) {
+        seen += s->hist[i];
+        if (seen >= rank) {
+            double v = hist_value(i) / 1e9;
+            if (v < s->min) v = s->min;
+            if (v > s->max) v = s->max;
+            return v;
+        }
+    }
+    return s->max;
+}
+
+//resource usage summed over every reaped child (from wait4)
+struct usage {
+    long runs;         //runs that had a child to reap
+    double utime;
+    double stime;
+    long maxrss_peak;  //KiB
+    double maxrss_sum; //KiB
+    long minflt;
+    long majflt;
+    long nvcsw;
+    long nivcsw;
+};
+
+//one raw run, kept only for --json/--csv
+struct sample {
+    double elapsed;
+    double launch_time;
+    int status;
+};
+
+//everything measured for one command
+struct result {
+    struct stats st;
+    long fails;
+    double launch_total; //launcher share of all samples
+    struct usage ru;
+    double perf[PERF_COUNTERS]; //-P counter totals charged to this command
+    long perf_runs[PERF_COUNTERS]; //runs whose counter opened and read back
+    int keep_samples;
+    struct sample *samples;
+    size_t nsamples;
+    size_t cap;
+};
+
+static double timeval_to_double(const struct timeval *tv) {
+    return (double)tv->tv_sec + (double)tv->tv_usec / 1e6;
+}
+
+/* One finished run: elapsed sample, launcher part of it, how it ended, its
+   rusage (NULL when the launcher resolved the run without a child to reap)
+   and its -P counts (NULL without -P, -1 where a counter is missing). */
+static void record(struct result *r, int status, double elapsed, double launch_time,
+                   const struct rusage *ru, const double *counts) {
+    stats_add(&r->st, elapsed);
+    r->launch_total += launch_time;
+    for (int i = 0; counts && i < PERF_COUNTERS; ++i) {
+        if (counts[i] < 0.0) continue;
+        r->perf[i] += counts[i];
+        r->perf_runs[i]++;
+    }
+
+    if (r->keep_samples) {
+        if (r->nsamples == r->cap) {
+            size_t cap = r->cap ? r->cap * 2 : 1024;
+            struct sample *grown = realloc(r->samples, cap * sizeof(*grown));
+            if (!grown) {
+                //keep the statistics going, only the raw dump gets truncated
+                fprintf(stderr, "Out of memory for raw samples, keeping %zu\n", r->nsamples);
+                r->keep_samples = 0;
+            } else {
+                r->samples = grown;
+                r->cap = cap;
+            }
+        }
+        if (r->keep_samples) {
+            r->samples[r->nsamples++] = (struct sample){ elapsed, launch_time, status };
+        }
+    }
+
+    if (ru) {
+        r->ru.runs++;
+        r->ru.utime += timeval_to_double(&ru->ru_utime);
+        r->ru.stime += timeval_to_double(&ru->ru_stime);
+        if (ru->ru_maxrss > r->ru.maxrss_peak) r->ru.maxrss_peak = ru->ru_maxrss;
+        r->ru.maxrss_sum += (double)ru->ru_maxrss;
+        r->ru.minflt += ru->ru_minflt;
+        r->ru.majflt += ru->ru_majflt;
+        r->ru.nvcsw += ru->ru_nvcsw;
+        r->ru.nivcsw += ru->ru_nivcsw;
+    }
+
+    /* Determine if this execution failed (non-zero exit or signal) */
+    if (WIFEXITED(status)) {
+        if (WEXITSTATUS(status) != 0) r->fails++;
+    } else {
+        // signaled or otherwise not normal exit
+        r->fails++;
+    }
+}
 
 static double timespec_to_double(const struct timespec *times) {
     return (double)times->tv_sec + (double)times->tv_nsec / 1e9; //turns nanoseconds into fractional seconds
 }
 
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return timespec_to_double(&t);
+}
+
+/* -P: one counter group per child, opened on its pid between fork and
+   exec. The counters start disabled and switch on at the exec
+   (enable_on_exec), so only the command is counted, and inherit folds in
+   whatever it forks in turn. They are read and closed once the child is
+   reaped. Counts only user space if the kernel refuses more. */
+struct perf_set {
+    int fd[PERF_COUNTERS]; //the first open one leads the group
+};
+
+//quiet: a per-child open, the counters were already reported by the probe
+static int perf_open(struct perf_set *p, pid_t pid, int quiet) {
+    int leader = -1, opened = 0;
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = perf_defs[i].config;
+        attr.disabled = leader < 0;
+        attr.inherit = 1;
+        attr.enable_on_exec = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        p->fd[i] = (int)syscall(SYS_perf_event_open, &attr, pid, -1, leader, PERF_FLAG_FD_CLOEXEC);
+        if (p->fd[i] < 0 && (errno == EACCES || errno == EPERM)) {
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            p->fd[i] = (int)syscall(SYS_perf_event_open, &attr, pid, -1, leader, PERF_FLAG_FD_CLOEXEC);
+        }
+        if (p->fd[i] < 0) {
+            if (!quiet) fprintf(stderr, "perf_event_open %s: %s\n", perf_defs[i].name, strerror(errno));
+        } else {
+            if (leader < 0) leader = p->fd[i];
+            opened++;
+        }
+    }
+    return opened > 0 ? 0 : -1;
+}
+
+//group totals scaled for multiplexing; -1 where a counter is unavailable
+static void perf_read(const struct perf_set *p, double *out) {
+    uint64_t v[3 + PERF_COUNTERS]; //nr, time enabled, time running, values in open order
+    int leader = -1;
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        out[i] = -1.0;
+        if (leader < 0 && p->fd[i] >= 0) leader = p->fd[i];
+    }
+    if (leader < 0 || read(leader, v, sizeof(v)) < (ssize_t)(3 * sizeof(uint64_t))) return;
+    double scale = (v[2] > 0 && v[2] < v[1]) ? (double)v[1] / (double)v[2] : 1.0;
+    for (int i = 0, k = 0; i < PERF_COUNTERS && (uint64_t)k < v[0]; ++i) {
+        if (p->fd[i] >= 0) out[i] = (double)v[3 + k++] * scale;
+    }
+}
+
+static void perf_close(struct perf_set *p) {
+    for (int i = 0; i < PERF_COUNTERS; ++i) {
+        if (p->fd[i] >= 0) close(p->fd[i]);
+        p->fd[i] = -1;
+    }
+}
+
+/* Child side shared by fork, vfork and clone: replace the image with the command.
+   On failure the error goes to ctx (visible to a parent sharing our memory) and
+   we leave with 127 like a shell does. Only async-signal-safe calls after exec. */
+static int child_exec(void *arg) {
+    struct child_ctx *ctx = arg;
+    execvp(ctx->argv[0], ctx->argv);
+    ctx->exec_err = errno;
+    _exit(127);
+}
+
+/* Start the command with the chosen backend. Returns the pid to wait for,
+   0 if the command could not be executed and there is no child left to reap
+   (posix_spawnp reaps it itself), or -1 if the launch itself failed.
+   *exec_err is the execvp errno. Every backend returns only once the child
+   has exec'd or given up, so the launch share means the same for all.
+   With perf (fork only) the child's counters are opened into it. */
+static pid_t launch(enum launcher how, char **cmd_argv, int *exec_err, struct perf_set *perf) {
+    static char *clone_stack; //reused for every clone launch
+    struct child_ctx ctx = { .argv = cmd_argv, .exec_err = 0 };
+    pid_t pid;
+
+    *exec_err = 0;
+    for (int i = 0; perf && i < PERF_COUNTERS; ++i) perf->fd[i] = -1;
+    switch (how) {
+        case LAUNCH_FORK: {
+            /* fork returns before the exec; hold the parent until the write
+               end closes: on a successful exec (close-on-exec) or with the
+               child's errno written to it */
+            int fds[2], go[2] = { -1, -1 };
+            if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+            //-P: the child holds off the exec until its counters are attached
+            if (perf && pipe2(go, O_CLOEXEC) != 0) {
+                int saved = errno;
+                close(fds[0]);
+                close(fds[1]);
+                errno = saved;
+                return -1;
+            }
+            pid = fork();
+            if (pid == 0) {
+                /*If we are inside the child proccess after fork then replace it with cmd_argv*/
+                close(fds[0]);
+                if (perf) {
+                    char c;
+                    close(go[1]);
+                    while (read(go[0], &c, 1) < 0 && errno == EINTR) {
+                    }
+                }
+                execvp(cmd_argv[0], cmd_argv);
+                int err = errno;
+                ssize_t n = write(fds[1], &err, sizeof(err));
+                (void)n;
+                _exit(127);
+            }
+            int saved = errno;
+            close(fds[1]);
+            if (perf) {
+                close(go[0]);
+                //a counter that fails to open (fd limit, EBUSY) stays -1 and reads
+                //back as missing, so this run is left out of its average
+                if (pid > 0) perf_open(perf, pid, 1);
+                close(go[1]); //EOF releases the child
+            }
+            if (pid > 0) {
+                int err;
+                ssize_t n;
+                while ((n = read(fds[0], &err, sizeof(err))) < 0 && errno == EINTR) {
+                }
+                if (n == (ssize_t)sizeof(err)) *exec_err = err;
+            }
+            close(fds[0]);
+            errno = saved;
+            return pid;
+        }
+        case LAUNCH_VFORK:
+            pid = vfork();
+            if (pid == 0) {
+                child_exec(&ctx);
+            }
+            break;
+        case LAUNCH_CLONE:
+            if (clone_stack == NULL) {
+                clone_stack = mmap(NULL, CLONE_STACK_SIZE, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+                if (clone_stack == MAP_FAILED) {
+                    clone_stack = NULL;
+                    return -1;
+                }
+            }
+            pid = clone(child_exec, clone_stack + CLONE_STACK_SIZE,
+                        CLONE_VM | CLONE_VFORK | SIGCHLD, &ctx);
+            break;
+        case LAUNCH_SPAWN: {
+            int rc = posix_spawnp(&pid, cmd_argv[0], NULL, NULL, cmd_argv, environ);
+            if (rc != 0) {
+                //glibc reports exec errors here and has already reaped the child
+                *exec_err = rc;
+                return 0;
+            }
+            return pid;
+        }
+        default:
+            errno = EINVAL;
+            return -1;
+    }
+
+    //vfork/clone: we resume only after the child exec'd or exited
+    if (pid > 0) {
+        *exec_err = ctx.exec_err;
+    }
+    return pid;
+}
+
+/* Launch the command once and wait for it. On success fills the wait status,
+   the whole sample time, the part of it spent in the launcher (until the
+   child had exec'd), the child's rusage and, given counts, its -P counters.
+   Returns 0, 1 if there was no child to reap (no rusage), or -1 on a
+   runtime error. */
+static int run_once(enum launcher how, char **cmd_argv, int *status,
+                    double *elapsed, double *launch_time, struct rusage *ru, double *counts) {
+    int exec_err;
+    struct perf_set perf;
+    double tstart = now();
+    pid_t pid = launch(how, cmd_argv, &exec_err, counts ? &perf : NULL);
+    double tlaunched = now();
+
+    if (pid < 0) {
+        fprintf(stderr, "%s: %s\n", launcher_names[how], strerror(errno));
+        return -1;
+    }
+    if (exec_err != 0) {
+        fprintf(stderr, "execvp failed: %s: %s\n", cmd_argv[0], strerror(exec_err));
+    }
+
+    if (pid == 0) {
+        //no child to reap; account it as the shell-style 127 exit
+        *status = 127 << 8;
+    } else {
+        while (wait4(pid, status, 0, ru) < 0) {
+            if (errno == EINTR) continue;
+            perror("wait4");
+            if (counts) perf_close(&perf);
+            return -1;
+        }
+    }
+
+    *elapsed = now() - tstart;
+    *launch_time = tlaunched - tstart;
+    if (counts) {
+        perf_read(&perf, counts);
+        perf_close(&perf);
+    }
+    return pid == 0 ? 1 : 0;
+}
+
+/* When to stop measuring. Fixed mode (rel_ci == 0) runs for `duration`
+   seconds. Adaptive mode runs until the 95% CI half-width of the mean is at
+   most rel_ci of the mean, or until `cap` seconds of wall time as a hard
+   limit, however many commands share it. */
+struct stop_rule {
+    double duration;
+    double rel_ci;
+    double cap;
+};
+
+//elapsed is the summed sample time for serial runs, wall time with -j
+static int should_stop(const struct stop_rule *rule, const struct stats *st, double elapsed,
+                       double wall) {
+    if (rule->rel_ci <= 0.0) {
+        return elapsed >= rule->duration;
+    }
+    if (wall >= rule->cap) {
+        return 1;
+    }
+    return st->count >= ADAPTIVE_MIN_RUNS && st->mean > 0.0 &&
+           stats_ci95(st) <= rule->rel_ci * st->mean;
+}
+
+//one command under test and everything measured for it
+struct command {
+    char **argv;
+    struct result res;
+};
+
+/* every command has met the stop rule (on its own sample time, or on wall
+   time with -j); the -x cap is always on the wall time of the whole run */
+static int all_stopped(const struct stop_rule *rule, const struct command *cmds, int ncmds,
+                       int by_wall, double wall) {
+    for (int i = 0; i < ncmds; ++i) {
+        const struct stats *st = &cmds[i].res.st;
+        if (!should_stop(rule, st, by_wall ? wall : st->total, wall)) return 0;
+    }
+    return 1;
+}
+
+/* Interleaving of the commands: every round runs each command once, in
+   the given order or reshuffled per round, so drift in temperature or
+   clock frequency lands on all of them alike. */
+struct order {
+    int *idx;
+    int n;
+    int pos;
+    int shuffle;
+};
+
+static int order_init(struct order *o, int n, int shuffle) {
+    o->idx = malloc(sizeof(int) * (size_t)n);
+    if (!o->idx) {
+        perror("malloc");
+        return -1;
+    }
+    for (int i = 0; i < n; ++i) o->idx[i] = i;
+    o->n = n;
+    o->pos = 0;
+    o->shuffle = shuffle;
+    return 0;
+}
+
+static int order_next(struct order *o) {
+    if (o->pos == 0 && o->shuffle) {
+        //Fisher-Yates
+        for (int i = o->n - 1; i > 0; --i) {
+            int j = (int)(random() % (i + 1));
+            int t = o->idx[i];
+            o->idx[i] = o->idx[j];
+            o->idx[j] = t;
+        }
+    }
+    int k = o->idx[o->pos];
+    o->pos = (o->pos + 1) % o->n;
+    return k;
+}
+
+/* Run rounds one child at a time until the stop rule holds for every
+   command (checked between rounds). With use_perf, each child's counters
+   are charged to its command. Returns -1 on a runtime error. */
+static int run_serial(enum launcher how, struct command *cmds, int ncmds, int shuffle,
+                      const struct stop_rule *rule, int use_perf, double *wall) {
+    struct order o;
+    double counts[PERF_COUNTERS];
+    int rc = 0;
+
+    if (order_init(&o, ncmds, shuffle) != 0) return -1;
+
+    double t0 = now();
+    while (o.pos != 0 || !all_stopped(rule, cmds, ncmds, 0, now() - t0)) {
+        struct command *c = &cmds[order_next(&o)];
+        int status;
+        double elapsed, launch_time;
+        struct rusage ru;
+        int ran = run_once(how, c->argv, &status, &elapsed, &launch_time, &ru,
+                           use_perf ? counts : NULL);
+        if (ran < 0) {
+            rc = -1;
+            break;
+        }
+        record(&c->res, status, elapsed, launch_time, ran == 0 ? &ru : NULL,
+               use_perf && ran == 0 ? counts : NULL);
+    }
+    *wall = now() - t0;
+    free(o.idx);
+    return rc;
+}
+
+//a child started by run_concurrent() that has not been reaped yet
+struct inflight {
+    pid_t pid;          //0 = free slot
+    int cmd;            //index into the command list
+    double tstart;
+    double launch_time;
+    struct perf_set perf; //-P: this child's counters
+};
+
+/* Keep `jobs` children running until the stop rule fires on wall time,
+   then drain the ones still in flight. Free slots are refilled with the
+   commands in interleaved order. Each sample runs from the launch to the
+   moment the reaper collects the child: block in wait4() for the first
+   exit, then WNOHANG to pick up everything else that has finished, so
+   there is no busy polling. With use_perf, each child's counters are
+   charged to its command when it is reaped. Returns -1 on a runtime error. */
+static int run_concurrent(enum launcher how, struct command *cmds, int ncmds, int shuffle,
+                          int jobs, const struct stop_rule *rule, int use_perf, double *wall) {
+    struct order o;
+    struct inflight *slots = calloc((size_t)jobs, sizeof(*slots));
+    if (!slots) {
+        perror("calloc");
+        return -1;
+    }
+    if (order_init(&o, ncmds, shuffle) != 0) {
+        free(slots);
+        return -1;
+    }
+    int active = 0;
+    int rc = 0;
+    double t0 = now();
+
+    for (;;) {
+        int launching = rc == 0 && !all_stopped(rule, cmds, ncmds, 1, now() - t0);
+
+        // refill every free slot
+        for (int i = 0; launching && i < jobs && active < jobs; ++i) {
+            if (slots[i].pid != 0) continue;
+            int k = order_next(&o);
+            char **cmd_argv = cmds[k].argv;
+            int exec_err;
+            double ts = now();
+            pid_t pid = launch(how, cmd_argv, &exec_err, use_perf ? &slots[i].perf : NULL);
+            double tl = now();
+            if (pid < 0) {
+                fprintf(stderr, "%s: %s\n", launcher_names[how], strerror(errno));
+                rc = -1;
+                break;
+            }
+            if (exec_err != 0) {
+                fprintf(stderr, "execvp failed: %s: %s\n", cmd_argv[0], strerror(exec_err));
+            }
+            if (pid == 0) {
+                //spawn failure, nothing to reap; slot stays free
+                record(&cmds[k].res, 127 << 8, tl - ts, tl - ts, NULL, NULL);
+                continue;
+            }
+            slots[i].pid = pid;
+            slots[i].cmd = k;
+            slots[i].tstart = ts;
+            slots[i].launch_time = tl - ts;
+            active++;
+        }
+
+        if (active == 0) {
+            if (launching) continue;
+            break;
+        }
+
+        // reap: block for one exit, then collect the rest that are ready
+        int flags = 0;
+        for (;;) {
+            int status;
+            struct rusage ru;
+            pid_t pid = wait4(-1, &status, flags, &ru);
+            if (pid == 0) break;
+            if (pid < 0) {
+                if (errno == EINTR) continue;
+                if (errno == ECHILD && active == 0) break; //drained
+                /* children still in flight that we cannot reap (with SIGCHLD
+                   ignored the kernel already did) lose their samples; give
+                   up the run and free the slots so nothing waits on them */
+                perror("wait4");
+                rc = -1;
+                for (int i = 0; i < jobs; ++i) {
+                    if (slots[i].pid != 0 && use_perf) perf_close(&slots[i].perf);
+                    slots[i].pid = 0;
+                }
+                active = 0;
+                break;
+            }
+            double tend = now();
+            for (int i = 0; i < jobs; ++i) {
+                if (slots[i].pid == pid) {
+                    double counts[PERF_COUNTERS];
+                    if (use_perf) {
+                        perf_read(&slots[i].perf, counts);
+                        perf_close(&slots[i].perf);
+                    }
+                    record(&cmds[slots[i].cmd].res, status, tend - slots[i].tstart,
+                           slots[i].launch_time, &ru, use_perf ? counts : NULL);
+                    slots[i].pid = 0;
+                    active--;
+                    break;
+                }
+            }
+            flags = WNOHANG;
+        }
+    }
+
+    *wall = now() - t0;
+    free(o.idx);
+    free(slots);
+    return rc;
+}
+
+/* Two-sided Mann-Whitney U test of a against b, computed on the histograms:
+   samples in the same bucket count as ties, so it needs no raw samples.
+   Normal approximation with tie correction. Returns the p-value. */
+static double mann_whitney_p(const struct stats *a, const struct stats *b) {
+    double na = (double)a->count, nb = (double)b->count, n = na + nb;
+    if (na < 1.0 || nb < 1.0) return 1.0;
+
+    double u = 0.0, below_b = 0.0, ties = 0.0;
+    for (unsigned i = 0; i < HIST_BUCKETS; ++i) {
+        double ca = (double)a->hist[i], cb = (double)b->hist[i];
+        u += ca * (below_b + cb / 2.0);
+        below_b += cb;
+        double t = ca + cb;
+        ties += t * t * t - t;
+    }
+    double var = na * nb / 12.0 * ((n + 1.0) - ties / (n * (n - 1.0)));
+    if (var <= 0.0) return 1.0;
+    double z = (u - na * nb / 2.0) / sqrt(var);
+    return erfc(fabs(z) / sqrt(2.0));
+}
+
+//summary block for one command, same layout whether it ran alone or not
+static void print_result(const struct result *r, long warmups, enum launcher how, int jobs,
+                         double wall, const struct stop_rule *rule, const int *perf_avail) {
+    const struct stats *st = &r->st;
+    if (st->count == 0) {
+        //No measured runs (possible if duration == 0)
+        printf("Duration was 0 so no measured runs were performed\n");
+        return;
+    }
+
+    long runs = (long)st->count;
+    double ci = stats_ci95(st);
+    printf("Min: %.6f seconds Warmups: %ld\n", st->min, warmups);
+    printf("Avg: %.6f seconds Runs: %ld\n", st->mean, runs);
+    printf("Max: %.6f seconds Fails: %ld\n", st->max, r->fails);
+    printf("Total: %.6f seconds\n", st->total);
+    printf("Stddev: %.6f seconds 95%% CI: [%.6f, %.6f]\n",
+           stats_stddev(st), st->mean - ci, st->mean + ci);
+    printf("P50: %.6f P90: %.6f P99: %.6f P99.9: %.6f seconds\n",
+           stats_percentile(st, 0.50), stats_percentile(st, 0.90),
+           stats_percentile(st, 0.99), stats_percentile(st, 0.999));
+    printf("Launch: %.6f seconds avg (%s, %.1f%% of each sample)\n",
+           r->launch_total / (double)runs, launcher_names[how],
+           st->total > 0.0 ? 100.0 * r->launch_total / st->total : 0.0);
+    printf("Throughput: %.2f runs/sec Wall: %.6f seconds Jobs: %d\n",
+           wall > 0.0 ? (double)runs / wall : 0.0, wall, jobs);
+    if (rule->rel_ci > 0.0) {
+        double rel = st->mean > 0.0 ? ci / st->mean : 0.0;
+        printf("Adaptive: relative CI %.2f%% target %.2f%% %s\n", 100.0 * rel,
+               100.0 * rule->rel_ci, rel <= rule->rel_ci ? "converged" : "hit cap");
+    }
+
+    const struct usage *u = &r->ru;
+    if (u->runs > 0) {
+        double n = (double)u->runs;
+        printf("CPU: user %.6f sys %.6f seconds per run\n", u->utime / n, u->stime / n);
+        printf("RSS: avg %.0f KiB peak %ld KiB Faults: minor %.1f major %.1f per run\n",
+               u->maxrss_sum / n, u->maxrss_peak, (double)u->minflt / n, (double)u->majflt / n);
+        printf("Context switches: voluntary %.1f involuntary %.1f per run\n",
+               (double)u->nvcsw / n, (double)u->nivcsw / n);
+    }
+    if (perf_avail && u->runs > 0) {
+        //each counter averages only the runs it was attached to
+        double avg[PERF_COUNTERS];
+        long missed = 0;
+        printf("Perf:");
+        for (int i = 0; i < PERF_COUNTERS; ++i) {
+            avg[i] = r->perf_runs[i] > 0 ? r->perf[i] / (double)r->perf_runs[i] : -1.0;
+            if (!perf_avail[i] || avg[i] < 0.0) printf(" %s n/a", perf_defs[i].name);
+            else printf(" %s %.0f", perf_defs[i].name, avg[i]);
+            if (perf_avail[i] && u->runs - r->perf_runs[i] > missed) missed = u->runs - r->perf_runs[i];
+        }
+        if (perf_avail[0] && perf_avail[1] && avg[0] > 0.0 && avg[1] >= 0.0) {
+            printf(" IPC %.2f", avg[1] / avg[0]);
+        }
+        printf(" per run\n");
+        if (missed > 0) {
+            printf("Perf: counters missing for up to %ld of %ld runs, left out of the averages\n",
+                   missed, u->runs);
+        }
+    }
+}
+
+//summary figures shared by the machine-readable outputs and the baseline check
+struct summary {
+    long runs;
+    long fails;
+    double min, mean, max, stddev, ci95, total;
+    double p50, p90, p99, p999;
+};
+
+static void summarize(const struct result *r, struct summary *s) {
+    const struct stats *st = &r->st;
+    s->runs = (long)st->count;
+    s->fails = r->fails;
+    s->min = st->min;
+    s->mean = st->mean;
+    s->max = st->max;
+    s->stddev = stats_stddev(st);
+    s->ci95 = stats_ci95(st);
+    s->total = st->total;
+    s->p50 = stats_percentile(st, 0.50);
+    s->p90 = stats_percentile(st, 0.90);
+    s->p99 = stats_percentile(st, 0.99);
+    s->p999 = stats_percentile(st, 0.999);
+}
+
+static void json_string(FILE *f, const char *str) {
+    fputc('"', f);
+    for (const unsigned char *p = (const unsigned char *)str; *p; ++p) {
+        if (*p == '"' || *p == '\\') fprintf(f, "\\%c", *p);
+        else if (*p < 0x20) fprintf(f, "\\u%04x", *p);
+        else fputc(*p, f);
+    }
+    fputc('"', f);
+}
+
+/* --json: run settings, then per command its argv, summary and every sample
+   as [elapsed, launch, wait status]. The layout is also what --baseline reads. */
+static void write_json(FILE *f, const struct command *cmds, int ncmds, long warmups,
+                       enum launcher how, int jobs, double wall) {
+    fprintf(f, "{\n  \"launcher\": \"%s\",\n  \"jobs\": %d,\n  \"warmups\": %ld,\n"
+               "  \"wall\": %.9f,\n  \"sample_fields\": [\"elapsed\", \"launch\", \"status\"],\n"
+               "  \"commands\": [\n", launcher_names[how], jobs, warmups, wall);
+    for (int k = 0; k < ncmds; ++k) {
+        const struct result *r = &cmds[k].res;
+        struct summary s;
+        summarize(r, &s);
+
+        fprintf(f, "    {\n      \"argv\": [");
+        for (char **a = cmds[k].argv; *a; ++a) {
+            if (a != cmds[k].argv) fprintf(f, ", ");
+            json_string(f, *a);
+        }
+        fprintf(f, "],\n      \"summary\": {\"runs\": %ld, \"fails\": %ld, \"min\": %.9f, "
+                   "\"mean\": %.9f, \"max\": %.9f, \"stddev\": %.9f, \"ci95\": %.9f, "
+                   "\"total\": %.9f, \"median\": %.9f, \"p90\": %.9f, \"p99\": %.9f, "
+                   "\"p999\": %.9f},\n      \"samples\": [",
+                s.runs, s.fails, s.min, s.mean, s.max, s.stddev, s.ci95, s.total,
+                s.p50, s.p90, s.p99, s.p999);
+        for (size_t i = 0; i < r->nsamples; ++i) {
+            const struct sample *x = &r->samples[i];
+            fprintf(f, "%s[%.9f, %.9f, %d]", i ? ", " : "", x->elapsed, x->launch_time, x->status);
+        }
+        fprintf(f, "]\n    }%s\n", k + 1 < ncmds ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+/* --csv: one "sample" row per run and one "summary" row per command under a
+   single header; columns that do not apply to a row are left empty. */
+static void write_csv(FILE *f, const struct command *cmds, int ncmds) {
+    fprintf(f, "record,command,run,elapsed,launch,status,"
+               "runs,fails,min,mean,max,stddev,ci95,median,p90,p99,p999\n");
+    for (int k = 0; k < ncmds; ++k) {
+        const struct result *r = &cmds[k].res;
+        for (size_t i = 0; i < r->nsamples; ++i) {
+            const struct sample *x = &r->samples[i];
+            fprintf(f, "sample,%d,%zu,%.9f,%.9f,%d,,,,,,,,,,,\n",
+                    k + 1, i + 1, x->elapsed, x->launch_time, x->status);
+        }
+        struct summary s;
+        summarize(r, &s);
+        fprintf(f, "summary,%d,,,,,%ld,%ld,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f\n",
+                k + 1, s.runs, s.fails, s.min, s.mean, s.max, s.stddev, s.ci95,
+                s.p50, s.p90, s.p99, s.p999);
+    }
+}
+
+//open an output path, "-" meaning the document stream (see stdout_for_data)
+static FILE *open_output(const char *path, FILE *data_out) {
+    if (strcmp(path, "-") == 0) return data_out;
+    FILE *f = fopen(path, "w");
+    if (!f) fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return f;
+}
+
+/* --json - / --csv -: the document owns stdout, so keep a private copy of
+   it and point fd 1 at /dev/null; otherwise every command inherits stdout
+   and whatever it prints lands in the middle of the document. */
+static FILE *stdout_for_data(void) {
+    fflush(stdout);
+    int fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    int null = open("/dev/null", O_WRONLY);
+    if (fd < 0 || null < 0 || dup2(null, STDOUT_FILENO) < 0) {
+        perror("stdout");
+        return NULL;
+    }
+    close(null);
+    FILE *f = fdopen(fd, "w");
+    if (!f) perror("fdopen");
+    return f;
+}
+
+/* Minimal reader for our own --json layout: enough JSON to walk the
+   structure (objects, arrays, strings, numbers, literals) without being
+   fooled by keys that appear inside strings. */
+static void json_ws(const char **p) {
+    while (**p == ' ' || **p == '\t' || **p == '\n' || **p == '\r') ++*p;
+}
+
+//string at *p; decoded into *out (malloc'd) unless out is NULL
+static int json_read_string(const char **p, char **out) {
+    json_ws(p);
+    if (**p != '"') return -1;
+    const char *s = ++*p;
+    char *buf = NULL, *w = NULL;
+    if (out) {
+        const char *e = s;
+        while (*e && *e != '"') e += (*e == '\\' && e[1]) ? 2 : 1;
+        buf = w = malloc((size_t)(e - s) + 1);
+        if (!buf) {
+            perror("malloc");
+            return -1;
+        }
+    }
+    while (*s != '"') {
+        unsigned c = (unsigned char)*s++;
+        if (c == '\0') goto bad;
+        if (c == '\\') {
+            switch (*s++) {
+                case '"':  c = '"'; break;
+                case '\\': c = '\\'; break;
+                case '/':  c = '/'; break;
+                case 'b':  c = '\b'; break;
+                case 'f':  c = '\f'; break;
+                case 'n':  c = '\n'; break;
+                case 'r':  c = '\r'; break;
+                case 't':  c = '\t'; break;
+                case 'u': {
+                    char hex[5] = { 0 };
+                    for (int i = 0; i < 4; ++i) {
+                        if (!s[i]) goto bad;
+                        hex[i] = s[i];
+                    }
+                    char *end;
+                    c = (unsigned)strtoul(hex, &end, 16);
+                    if (*end != '\0') goto bad;
+                    s += 4;
+                    //our writer only escapes bytes; wider code points as UTF-8
+                    if (c >= 0x800 && w) {
+                        *w++ = (char)(0xe0 | (c >> 12));
+                        *w++ = (char)(0x80 | ((c >> 6) & 0x3f));
+                        c = 0x80 | (c & 0x3f);
+                    } else if (c >= 0x80 && w) {
+                        *w++ = (char)(0xc0 | (c >> 6));
+                        c = 0x80 | (c & 0x3f);
+                    }
+                    break;
+                }
+                default:
+                    goto bad;
+            }
+        }
+        if (w) *w++ = (char)c;
+    }
+    *p = s + 1;
+    if (out) {
+        *w = '\0';
+        *out = buf;
+    }
+    return 0;
+bad:
+    free(buf);
+    return -1;
+}
+
+static int json_skip(const char **p) {
+    json_ws(p);
+    char open = **p;
+    if (open == '"') return json_read_string(p, NULL);
+    if (open == '{' || open == '[') {
+        char close = open == '{' ? '}' : ']';
+        ++*p;
+        json_ws(p);
+        if (**p == close) {
+            ++*p;
+            return 0;
+        }
+        for (;;) {
+            if (open == '{') {
+                if (json_read_string(p, NULL) != 0) return -1;
+                json_ws(p);
+                if (*(*p)++ != ':') return -1;
+            }
+            if (json_skip(p) != 0) return -1;
+            json_ws(p);
+            char c = *(*p)++;
+            if (c == close) return 0;
+            if (c != ',') return -1;
+        }
+    }
+    const char *s = *p;
+    while (**p && strchr("+-.0123456789eEaflnrstu", **p)) ++*p;
+    return *p == s ? -1 : 0;
+}
+
+/* Walk the members of the object at *p: fn sees each key with *p on its
+   value and must consume that value. */
+static int json_object(const char **p, int (*fn)(const char **p, const char *key, void *arg),
+                       void *arg) {
+    json_ws(p);
+    if (*(*p)++ != '{') return -1;
+    json_ws(p);
+    if (**p == '}') {
+        ++*p;
+        return 0;
+    }
+    for (;;) {
+        char *key;
+        if (json_read_string(p, &key) != 0) return -1;
+        json_ws(p);
+        int rc = *(*p)++ == ':' ? fn(p, key, arg) : -1;
+        free(key);
+        if (rc != 0) return -1;
+        json_ws(p);
+        char c = *(*p)++;
+        if (c == '}') return 0;
+        if (c != ',') return -1;
+    }
+}
+
+//one command of a saved --json run
+struct baseline_cmd {
+    char **argv;    //NULL-terminated
+    int argc;
+    double median;  //<= 0 when absent
+    double p99;
+    int used;       //already matched to a command of this run
+};
+
+struct baseline {
+    struct baseline_cmd *cmds;
+    int n, cap;
+};
+
+static int json_number(const char **p, double *out) {
+    json_ws(p);
+    char *end;
+    *out = strtod(*p, &end);
+    if (end == *p) return -1;
+    *p = end;
+    return 0;
+}
+
+static int baseline_summary_member(const char **p, const char *key, void *arg) {
+    struct baseline_cmd *b = arg;
+    if (strcmp(key, "median") == 0) return json_number(p, &b->median);
+    if (strcmp(key, "p99") == 0) return json_number(p, &b->p99);
+    return json_skip(p);
+}
+
+static int baseline_command_member(const char **p, const char *key, void *arg) {
+    struct baseline_cmd *b = arg;
+    if (strcmp(key, "summary") == 0) return json_object(p, baseline_summary_member, b);
+    if (strcmp(key, "argv") != 0) return json_skip(p);
+
+    json_ws(p);
+    if (*(*p)++ != '[') return -1;
+    json_ws(p);
+    if (**p == ']') {
+        ++*p;
+        return 0;
+    }
+    for (;;) {
+        char **grown = realloc(b->argv, sizeof(char *) * ((size_t)b->argc + 2));
+        if (!grown) {
+            perror("realloc");
+            return -1;
+        }
+        b->argv = grown;
+        b->argv[b->argc + 1] = NULL;
+        if (json_read_string(p, &b->argv[b->argc]) != 0) return -1;
+        b->argc++;
+        json_ws(p);
+        char c = *(*p)++;
+        if (c == ']') return 0;
+        if (c != ',') return -1;
+    }
+}
+
+static int baseline_member(const char **p, const char *key, void *arg) {
+    struct baseline *bl = arg;
+    if (strcmp(key, "commands") != 0) return json_skip(p);
+
+    json_ws(p);
+    if (*(*p)++ != '[') return -1;
+    json_ws(p);
+    if (**p == ']') {
+        ++*p;
+        return 0;
+    }
+    for (;;) {
+        if (bl->n == bl->cap) {
+            int cap = bl->cap ? bl->cap * 2 : 4;
+            struct baseline_cmd *grown = realloc(bl->cmds, sizeof(*grown) * (size_t)cap);
+            if (!grown) {
+                perror("realloc");
+                return -1;
+            }
+            bl->cmds = grown;
+            bl->cap = cap;
+        }
+        struct baseline_cmd *b = &bl->cmds[bl->n++];
+        memset(b, 0, sizeof(*b));
+        if (json_object(p, baseline_command_member, b) != 0) return -1;
+        json_ws(p);
+        char c = *(*p)++;
+        if (c == ']') return 0;
+        if (c != ',') return -1;
+    }
+}
+
+static void baseline_free(struct baseline *bl) {
+    for (int i = 0; i < bl->n; ++i) {
+        for (int j = 0; j < bl->cmds[i].argc; ++j) free(bl->cmds[i].argv[j]);
+        free(bl->cmds[i].argv);
+    }
+    free(bl->cmds);
+}
+
+//first baseline command not yet matched whose argv is exactly this one
+static struct baseline_cmd *baseline_match(struct baseline *bl, char **argv) {
+    for (int i = 0; i < bl->n; ++i) {
+        struct baseline_cmd *b = &bl->cmds[i];
+        if (b->used) continue;
+        int j = 0;
+        while (j < b->argc && argv[j] && strcmp(b->argv[j], argv[j]) == 0) j++;
+        if (j == b->argc && argv[j] == NULL) {
+            b->used = 1;
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* --baseline: compare median and p99 of every command with the run of the
+   same argv in the saved --json file, reporting to out. Returns 1 if any of them got slower by more than
+   threshold (a fraction), 0 if not, -1 if the baseline cannot be used. */
+static int check_baseline(FILE *out, const char *path, const struct command *cmds, int ncmds,
+                          double threshold) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    char *doc = NULL;
+    size_t len = 0, cap = 0;
+    for (;;) {
+        if (len + 4096 + 1 > cap) {
+            cap = cap ? cap * 2 : 65536;
+            char *grown = realloc(doc, cap);
+            if (!grown) {
+                perror("realloc");
+                free(doc);
+                fclose(f);
+                return -1;
+            }
+            doc = grown;
+        }
+        size_t n = fread(doc + len, 1, cap - len - 1, f);
+        len += n;
+        if (n == 0) break;
+    }
+    fclose(f);
+    doc[len] = '\0';
+
+    struct baseline bl = { NULL, 0, 0 };
+    const char *p = doc;
+    int bad_doc = json_object(&p, baseline_member, &bl) != 0;
+    free(doc);
+    if (bad_doc) {
+        fprintf(stderr, "%s: not a --json file from this tool\n", path);
+        baseline_free(&bl);
+        return -1;
+    }
+
+    int regressed = 0, compared = 0;
+    static const char *keys[] = { "median", "p99" };
+    fprintf(out, "\n");
+    for (int k = 0; k < ncmds; ++k) {
+        struct summary s;
+        summarize(&cmds[k].res, &s);
+        struct baseline_cmd *b = baseline_match(&bl, cmds[k].argv);
+        if (!b) {
+            fprintf(out, "Baseline %d: command not in %s\n", k + 1, path);
+            continue;
+        }
+        double cur[2] = { s.p50, s.p99 };
+        double prev[2] = { b->median, b->p99 };
+        for (int j = 0; j < 2; ++j) {
+            double base = prev[j];
+            if (base <= 0.0 || s.runs == 0) continue;
+            double change = cur[j] / base - 1.0;
+            int bad = change > threshold;
+            fprintf(out, "Baseline %d %s: %.6f -> %.6f seconds (%+.1f%%)%s\n", k + 1, keys[j],
+                   base, cur[j], 100.0 * change, bad ? " REGRESSION" : "");
+            regressed |= bad;
+            compared++;
+        }
+    }
+    baseline_free(&bl);
+    if (compared == 0) {
+        fprintf(stderr, "%s: no comparable summary found\n", path);
+        return -1;
+    }
+    return regressed;
+}
+
+//parse a cpu list like "0-3,6" into set
+static int parse_cpulist(const char *s, cpu_set_t *set) {
+    CPU_ZERO(set);
+    while (*s) {
+        char *end;
+        errno = 0;
+        long lo = strtol(s, &end, 10);
+        long hi = lo;
+        if (errno != 0 || end == s || lo < 0) return -1;
+        if (*end == '-') {
+            s = end + 1;
+            hi = strtol(s, &end, 10);
+            if (errno != 0 || end == s || hi < lo) return -1;
+        }
+        if (hi >= CPU_SETSIZE) return -1;
+        for (long c = lo; c <= hi; ++c) CPU_SET((int)c, set);
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        s = end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+/* Variance-reduction controls, applied to ourselves before the first launch
+   so that every child inherits them across fork/clone and exec. Failing to
+   get a privilege-dependent setting is reported but not fatal. */
+static int apply_controls(const cpu_set_t *cpus, int fifo_prio, int set_nice, int nice_val,
+                          int no_aslr) {
+    if (cpus && sched_setaffinity(0, sizeof(*cpus), cpus) != 0) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+    if (fifo_prio > 0) {
+        struct sched_param sp = { .sched_priority = fifo_prio };
+        if (sched_setscheduler(0, SCHED_FIFO, &sp) != 0) {
+            fprintf(stderr, "SCHED_FIFO %d not applied: %s\n", fifo_prio, strerror(errno));
+        }
+    }
+    if (set_nice && setpriority(PRIO_PROCESS, 0, nice_val) != 0) {
+        fprintf(stderr, "nice %d not applied: %s\n", nice_val, strerror(errno));
+    }
+    if (no_aslr) {
+        int persona = personality(0xffffffff);
+        if (persona < 0 || personality((unsigned long)persona | ADDR_NO_RANDOMIZE) < 0) {
+            fprintf(stderr, "ADDR_NO_RANDOMIZE not applied: %s\n", strerror(errno));
+        }
+    }
+    return 0;
+}
+
+static int parse_launcher(const char *s, enum launcher *how) {
+    for (int i = 0; i < (int)(sizeof(launcher_names) / sizeof(launcher_names[0])); ++i) {
+        if (strcmp(s, launcher_names[i]) == 0) {
+            *how = (enum launcher)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
 int main(int argc, char *argv[]) {
     int opt;
     long warmups = 0;
-    double duration = 5.0;
     int runtime_error = 0;
+    enum launcher how = LAUNCH_FORK;
+    int jobs = 1;
+    int use_perf = 0;
+    struct stop_rule rule = { .duration = 5.0, .rel_ci = 0.0, .cap = ADAPTIVE_CAP };
+    cpu_set_t cpus;
+    int pin = 0;
+    int fifo_prio = 0;
+    int set_nice = 0;
+    int nice_val = 0;
+    int no_aslr = 0;
+    int shuffle = 0;
+    const char *json_path = NULL;
+    const char *csv_path = NULL;
+    const char *baseline_path = NULL;
+    double threshold = REGRESS_THRESHOLD;
 
-    /* Parsing the command and options*/
-    while ((opt = getopt(argc, argv, "w:d:")) != -1) {
+    static const struct option longopts[] = {
+        { "json",      required_argument, NULL, 'J' },
+        { "csv",       required_argument, NULL, 'C' },
+        { "baseline",  required_argument, NULL, 'B' },
+        { "threshold", required_argument, NULL, 'T' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    /* Parsing the command and options; stop at the first command word so
+       the commands keep their own options */
+    while ((opt = getopt_long(argc, argv, "+w:d:m:j:Pc:f:n:Ae:x:R", longopts, NULL)) != -1) {
         switch (opt) {
             //Warmup command default 0
             case 'w': {
@@ -51,7 +1311,120 @@ int main(int argc, char *argv[]) {
                     fprintf(stderr, "Invalid duration value: %s\n", optarg);
                     return 2;
                 }
-                duration = v;
+                rule.duration = v;
+                break;
+            }
+            //Launch backend default fork
+            case 'm':
+                if (parse_launcher(optarg, &how) != 0) {
+                    fprintf(stderr, "Invalid launcher: %s (fork|vfork|spawn|clone)\n", optarg);
+                    return 2;
+                }
+                break;
+            //Children kept in flight at once default 1
+            case 'j': {
+                char *end;
+                errno = 0;
+                long val = strtol(optarg, &end, 10);
+                if (errno != 0 || *end != '\0' || val < 1 || val > INT_MAX) {
+                    fprintf(stderr, "Invalid jobs value: %s\n", optarg);
+                    return 2;
+                }
+                jobs = (int)val;
+                break;
+            }
+            //Hardware counters per run
+            case 'P':
+                use_perf = 1;
+                break;
+            //Pin bench and its children to a cpu list
+            case 'c':
+                if (parse_cpulist(optarg, &cpus) != 0) {
+                    fprintf(stderr, "Invalid cpu list: %s\n", optarg);
+                    return 2;
+                }
+                pin = 1;
+                break;
+            //SCHED_FIFO priority
+            case 'f': {
+                char *end;
+                errno = 0;
+                long val = strtol(optarg, &end, 10);
+                if (errno != 0 || *end != '\0' || val < sched_get_priority_min(SCHED_FIFO) ||
+                    val > sched_get_priority_max(SCHED_FIFO)) {
+                    fprintf(stderr, "Invalid SCHED_FIFO priority: %s\n", optarg);
+                    return 2;
+                }
+                fifo_prio = (int)val;
+                break;
+            }
+            //Nice level
+            case 'n': {
+                char *end;
+                errno = 0;
+                long val = strtol(optarg, &end, 10);
+                if (errno != 0 || *end != '\0' || val < -20 || val > 19) {
+                    fprintf(stderr, "Invalid nice value: %s\n", optarg);
+                    return 2;
+                }
+                set_nice = 1;
+                nice_val = (int)val;
+                break;
+            }
+            //Disable ASLR for the children
+            case 'A':
+                no_aslr = 1;
+                break;
+            //Adaptive stop: relative CI of the mean, e.g. 0.01 for 1%
+            case 'e': {
+                char *end;
+                errno = 0;
+                double v = strtod(optarg, &end);
+                if (errno != 0 || *end != '\0' || v <= 0.0) {
+                    fprintf(stderr, "Invalid relative CI value: %s\n", optarg);
+                    return 2;
+                }
+                rule.rel_ci = v;
+                break;
+            }
+            //Hard cap for -e in seconds of wall time for the whole run
+            case 'x': {
+                char *end;
+                errno = 0;
+                double v = strtod(optarg, &end);
+                if (errno != 0 || *end != '\0' || v <= 0.0) {
+                    fprintf(stderr, "Invalid cap value: %s\n", optarg);
+                    return 2;
+                }
+                rule.cap = v;
+                break;
+            }
+            //Randomize the interleaving order every round
+            case 'R':
+                shuffle = 1;
+                break;
+            //Raw samples and summary as JSON / CSV ("-" for stdout, the
+            //commands' own output then goes to /dev/null)
+            case 'J':
+                json_path = optarg;
+                break;
+            case 'C':
+                csv_path = optarg;
+                break;
+            //Saved --json run to compare against
+            case 'B':
+                baseline_path = optarg;
+                break;
+            //Allowed slowdown of median/p99 in percent default 5
+            case 'T': {
+                char *end;
+                errno = 0;
+                double v = strtod(optarg, &end);
+                if (errno != 0 || *end != '\0' || v < 0.0) {
+                    fprintf(stderr, "Invalid threshold value: %s\n", optarg);
+                    return 2;
+                }
+                threshold = v;
                 break;
             }
             default:
@@ -59,125 +1432,154 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    //counters are attached between fork and exec, which only fork leaves room for
+    if (use_perf && how != LAUNCH_FORK) {
+        fprintf(stderr, "-P needs the fork launcher (-m fork)\n");
+        return 2;
+    }
+
     //Command missing an argument to run
     if (optind >= argc) {
         fprintf(stderr, "Missing command to run.\n");
         return 2;
     }
 
-    char **cmd_argv = &argv[optind];
+    //Split the rest into commands at "--" or ":::"
+    int ncmds = 1;
+    for (int i = optind; i < argc; ++i) {
+        if (strcmp(argv[i], "--") == 0 || strcmp(argv[i], ":::") == 0) ncmds++;
+    }
+    struct command *cmds = calloc((size_t)ncmds, sizeof(*cmds)); //~30 KiB each
+    if (!cmds) {
+        perror("calloc");
+        return 1;
+    }
+    ncmds = 0;
+    cmds[ncmds++].argv = &argv[optind];
+    for (int i = optind; i < argc; ++i) {
+        if (strcmp(argv[i], "--") == 0 || strcmp(argv[i], ":::") == 0) {
+            argv[i] = NULL; //terminates the previous command's argv
+            cmds[ncmds++].argv = &argv[i + 1];
+        }
+    }
+    for (int k = 0; k < ncmds; ++k) {
+        if (cmds[k].argv[0] == NULL) {
+            fprintf(stderr, "Missing command to run.\n");
+            return 2;
+        }
+        stats_init(&cmds[k].res.st);
+        cmds[k].res.keep_samples = json_path != NULL || csv_path != NULL;
+    }
 
-    /* Warmup runs */
-    for (long i = 0; i < warmups; ++i) {
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork (warmup)");
-            runtime_error = 1;
-            break;
-        } else if (pid == 0) {
-            /*If we are inside the child proccess after fork then replace it with cmd_argv*/
-            execvp(cmd_argv[0], cmd_argv); 
-            // exec failed
-            fprintf(stderr, "execvp failed: %s: %s\n", cmd_argv[0], strerror(errno));
-            _exit(127);
-        } else {
-            // parent: wait for child
+    if (apply_controls(pin ? &cpus : NULL, fifo_prio, set_nice, nice_val, no_aslr) != 0) {
+        return 1;
+    }
+    srandom((unsigned)getpid() ^ (unsigned)time(NULL));
+
+    //a document on stdout: the commands write to /dev/null instead
+    FILE *data_out = stdout;
+    if ((json_path && strcmp(json_path, "-") == 0) || (csv_path && strcmp(csv_path, "-") == 0)) {
+        data_out = stdout_for_data();
+        if (!data_out) return 1;
+    }
+
+    /* Warmup runs, interleaved like the measured ones */
+    for (long i = 0; i < warmups && !runtime_error; ++i) {
+        for (int k = 0; k < ncmds; ++k) {
             int status;
-            while (waitpid(pid, &status, 0) < 0) {
-                if (errno == EINTR) continue;
-                perror("waitpid (warmup)");
+            double elapsed, launch_time;
+            struct rusage ru;
+            if (run_once(how, cmds[k].argv, &status, &elapsed, &launch_time, &ru, NULL) < 0) {
                 runtime_error = 1;
                 break;
             }
-            if (runtime_error) break;
         }
     }
 
     /* If a runtime error already occurred during warmups then abort */
     if (runtime_error) return 1;
 
-    // Measurement variables
-    long runs = 0;
-    long fails = 0;
-    double total = 0.0;
-    double min = 0.0;
-    double max = 0.0;
-
-    // Run measured loop until total >= duration
-    while (total < duration) {
-        struct timespec tstart, tend;
-        if (clock_gettime(CLOCK_MONOTONIC, &tstart) != 0) {
-            perror("clock_gettime (start)");
-            runtime_error = 1;
-            break;
+    // Measurement
+    double wall = 0.0;
+    int perf_avail[PERF_COUNTERS];
+
+    //probe once on ourselves which counters the children can get; never enabled
+    if (use_perf) {
+        struct perf_set probe;
+        if (perf_open(&probe, 0, 0) != 0) {
+            fprintf(stderr, "No hardware counters available, continuing without -P\n");
+            use_perf = 0;
         }
+        for (int i = 0; i < PERF_COUNTERS; ++i) perf_avail[i] = use_perf && probe.fd[i] >= 0;
+        perf_close(&probe);
+    }
 
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork");
+    if (jobs > 1) {
+        if (run_concurrent(how, cmds, ncmds, shuffle, jobs, &rule, use_perf, &wall) != 0) {
             runtime_error = 1;
-            break;
-        } else if (pid == 0) {
-            // child executes the command
-            execvp(cmd_argv[0], cmd_argv);
-            // execution failed
-            fprintf(stderr, "execvp failed: %s: %s\n", cmd_argv[0], strerror(errno));
-            _exit(127);
-        } else {
-            // parent waits
-            int status;
-            pid_t w;
-            for (;;) {
-                w = waitpid(pid, &status, 0);
-                if (w < 0) {
-                    if (errno == EINTR) continue;
-                    perror("waitpid");
-                    runtime_error = 1;
-                }
-                break;
-            }
-            if (runtime_error) break;
-
-            if (clock_gettime(CLOCK_MONOTONIC, &tend) != 0) {
-                perror("clock_gettime (end)");
-                runtime_error = 1;
-                break;
-            }
+        }
+    } else {
+        // Run measured loop until total >= duration (or the -e rule is met)
+        if (run_serial(how, cmds, ncmds, shuffle, &rule, use_perf, &wall) != 0) {
+            runtime_error = 1;
+        }
+    }
 
-            double elapsed = timespec_to_double(&tend) - timespec_to_double(&tstart);
+    //machine-readable output; the human summary is skipped if it took stdout
+    int quiet = 0;
+    if (json_path) {
+        FILE *f = open_output(json_path, data_out);
+        if (!f) return 1;
+        write_json(f, cmds, ncmds, warmups, how, jobs, wall);
+        if (f == data_out) quiet = 1;
+        else fclose(f);
+    }
+    if (csv_path) {
+        FILE *f = open_output(csv_path, data_out);
+        if (!f) return 1;
+        write_csv(f, cmds, ncmds);
+        if (f == data_out) quiet = 1;
+        else fclose(f);
+    }
+    fflush(data_out);
 
-            /* Update stats */
-            if (runs == 0) {
-                min = max = elapsed;
-            } else {
-                if (elapsed < min) min = elapsed;
-                if (elapsed > max) max = elapsed;
-            }
-            total += elapsed;
-            runs++;
+    // Print summary
+    for (int k = 0; k < ncmds && !quiet; ++k) {
+        if (ncmds > 1) {
+            printf("%sCommand %d:", k > 0 ? "\n" : "", k + 1);
+            for (char **a = cmds[k].argv; *a; ++a) printf(" %s", *a);
+            printf("\n");
+        }
+        print_result(&cmds[k].res, warmups, how, jobs, wall, &rule, use_perf ? perf_avail : NULL);
+    }
 
-            /* Determine if this execution failed (non-zero exit or signal) */
-            if (WIFEXITED(status)) {
-                if (WEXITSTATUS(status) != 0) fails++;
-            } else {
-                // signaled or otherwise not normal exit
-                fails++;
-            }
+    //each command against the first one
+    if (ncmds > 1 && !quiet) {
+        const struct stats *base = &cmds[0].res.st;
+        printf("\n");
+        for (int k = 1; k < ncmds; ++k) {
+            const struct stats *st = &cmds[k].res.st;
+            if (base->count == 0 || st->count == 0) continue;
+            printf("Speedup of %d over 1: mean %.3fx median %.3fx p=%.4g (Mann-Whitney U)\n",
+                   k + 1, base->mean / st->mean,
+                   stats_percentile(base, 0.5) / stats_percentile(st, 0.5),
+                   mann_whitney_p(base, st));
         }
     }
 
-    // Print summary
-    if (runs > 0) {
-        double avg = total / (double)runs;
-        printf("Min: %.6f seconds Warmups: %ld\n", min, warmups);
-        printf("Avg: %.6f seconds Runs: %ld\n", avg, runs);
-        printf("Max: %.6f seconds Fails: %ld\n", max, fails);
-        printf("Total: %.6f seconds\n", total);
-    } else {
-        //No measured runs (possible if duration == 0)
-        printf("Duration was 0 so no measured runs were performed\n");
+    //regression gate: exit 3 if median or p99 got slower than the baseline allows
+    int regressed = 0;
+    if (baseline_path) {
+        //keep a machine-readable stdout clean
+        regressed = check_baseline(quiet ? stderr : stdout, baseline_path, cmds, ncmds,
+                                   threshold / 100.0);
+        if (regressed < 0) runtime_error = 1;
     }
 
-    // Return non-zero if a runtime error occurred
-    return runtime_error ? 1 : 0;
+    for (int k = 0; k < ncmds; ++k) free(cmds[k].res.samples);
+    free(cmds);
+
+    // Return non-zero if a runtime error occurred, 3 on a regression
+    if (runtime_error) return 1;
+    return regressed > 0 ? 3 : 0;
 }
@@ -5,7 +5,7 @@ Operating Systems
 Redon Jashari 
 */
 
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE // pthread_setaffinity_np, cpu_set_t
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -14,6 +14,31 @@ Redon Jashari
 #include <pthread.h>
 #include <getopt.h>
 #include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <math.h>
+#include <string.h>
+#include <sched.h>
+#include <dirent.h>
+#include <fcntl.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define DEFAULT_CHUNK 4096 // numbers handed out per dispenser claim
+#define DEFAULT_L2 (256 * 1024) // assumed L2 size if sysconf cannot tell
+#define DEFAULT_PMAX 2000 // -M: default last exponent
+#define MAX_EXPONENT (1u << 30) // -M: keeps limb counts well inside size_t
+#define KARATSUBA_LIMBS 32 // squarings at least this long split recursively
+#define SIMD_EXACT_LIMIT (1ull << 52) // below this n/d in double floors exactly
+#define MERGE_POLL_NS 1000000 // merger sleep between passes (1 ms)
+#define JOURNAL_INTERVAL 10.0 // seconds between checkpoint rewrites
+#define JOURNAL_MAGIC "perfect-journal 1"
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+// how candidates are tested
+enum engine { ENGINE_TRIAL = 0, ENGINE_SIEVE, ENGINE_MERSENNE };
+static const char *engine_names[] = { "trial", "sieve", "mersenne" };
 
 
 //defined is_perfect function
@@ -35,35 +60,889 @@ is_perfect(uint64_t num)
     return (sum == num);
 }
 
+// trial-division kernels, all with the is_perfect() contract
+typedef int (*perfect_fn)(uint64_t);
+
+struct kernel {
+    const char *name;
+    perfect_fn test;
+    int (*usable)(void);
+};
+
+static uint64_t
+isqrt(uint64_t n)
+{
+    uint64_t r = (uint64_t)sqrtl((long double)n);
+    while (r > 0 && (r > UINT32_MAX || r * r > n)) r--;
+    while (r < UINT32_MAX && (r + 1) * (r + 1) <= n) r++;
+    return r;
+}
+
+// add the divisor pairs (d, num/d) flagged in mask, d = base + bit index
+static uint64_t
+add_hits(uint64_t num, uint64_t base, unsigned mask)
+{
+    uint64_t sum = 0;
+    for (; mask; mask &= mask - 1) {
+        uint64_t d = base + (uint64_t)__builtin_ctz(mask);
+        sum += (d * d == num) ? d : d + num / d;
+    }
+    return sum;
+}
+
+static int
+scalar_usable(void)
+{
+    return 1;
+}
+
+#if defined(__x86_64__)
+/* SIMD kernels: W divisors per iteration with one vector double divide
+   instead of W 64-bit integer divides. For n, d < 2^52 the quotient
+   q = trunc(n / d) is exact (n/d is at least 1/d away from the next
+   integer, more than half an ulp), so d | n iff q * d == n. Hits are
+   rare and summed in integers; larger n use the scalar reference. */
+__attribute__((target("avx2")))
+static int
+is_perfect_avx2(uint64_t num)
+{
+    if (num < 2 || num >= SIMD_EXACT_LIMIT) return is_perfect(num);
+
+    uint64_t r = isqrt(num), sum = 1, i = 2;
+    __m256d vn = _mm256_set1_pd((double)num);
+    __m256d vd = _mm256_setr_pd(2.0, 3.0, 4.0, 5.0);
+    __m256d step = _mm256_set1_pd(4.0);
+
+    for (; i + 3 <= r; i += 4) {
+        __m256d q = _mm256_round_pd(_mm256_div_pd(vn, vd),
+                                    _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        __m256d eq = _mm256_cmp_pd(_mm256_mul_pd(q, vd), vn, _CMP_EQ_OQ);
+        unsigned mask = (unsigned)_mm256_movemask_pd(eq);
+        if (mask) sum += add_hits(num, i, mask);
+        vd = _mm256_add_pd(vd, step);
+    }
+    for (; i <= r; ++i) {
+        if (num % i == 0) sum += (i * i == num) ? i : i + num / i;
+    }
+    return sum == num;
+}
+
+__attribute__((target("avx512f")))
+static int
+is_perfect_avx512(uint64_t num)
+{
+    if (num < 2 || num >= SIMD_EXACT_LIMIT) return is_perfect(num);
+
+    uint64_t r = isqrt(num), sum = 1, i = 2;
+    __m512d vn = _mm512_set1_pd((double)num);
+    __m512d vd = _mm512_setr_pd(2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0, 9.0);
+    __m512d step = _mm512_set1_pd(8.0);
+
+    for (; i + 7 <= r; i += 8) {
+        __m512d q = _mm512_roundscale_pd(_mm512_div_pd(vn, vd), _MM_FROUND_TO_ZERO);
+        __mmask8 mask = _mm512_cmp_pd_mask(_mm512_mul_pd(q, vd), vn, _CMP_EQ_OQ);
+        if (mask) sum += add_hits(num, i, mask);
+        vd = _mm512_add_pd(vd, step);
+    }
+    for (; i <= r; ++i) {
+        if (num % i == 0) sum += (i * i == num) ? i : i + num / i;
+    }
+    return sum == num;
+}
+
+static int
+avx2_usable(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+static int
+avx512_usable(void)
+{
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+// widest first, so auto picks the first usable one
+static const struct kernel kernels[] = {
+#if defined(__x86_64__)
+    { "avx512", is_perfect_avx512, avx512_usable },
+    { "avx2", is_perfect_avx2, avx2_usable },
+#endif
+    { "scalar", is_perfect, scalar_usable },
+};
+#define NKERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+// kernel by name ("auto" = best the CPU supports), NULL if unknown/unusable
+static const struct kernel *
+pick_kernel(const char *name)
+{
+    for (size_t i = 0; i < NKERNELS; ++i) {
+        if (strcmp(name, "auto") != 0 && strcmp(name, kernels[i].name) != 0) continue;
+        if (kernels[i].usable()) return &kernels[i];
+        if (strcmp(name, "auto") != 0) return NULL;
+    }
+    return NULL;
+}
+
+/* Segmented divisor-sum sieve: fill the sums of the proper divisors of a
+   whole cache-sized segment at once. Every divisor pair (d, q) with
+   d <= q = m/d is visited once by walking the multiples m of each
+   d <= sqrt(m), with q tracked incrementally so the walk has no division.
+   A window of up to SIEVE_WINDOW segments shares the divisor state: each
+   divisor d gets one modulo per window to find its first multiple, and is
+   then carried from segment to segment. Divisors below the segment length
+   keep their next cofactor in q[d]; larger ones hit a segment at most
+   once, so they wait in the bucket of the segment holding their next
+   multiple. Sums saturate at UINT64_MAX, which is still > n, so the
+   perfect test sum == n stays exact. */
+#define SIEVE_WINDOW 32 // segments sharing one set of first-multiple divisions
+#define SIEVE_NIL UINT32_MAX
+
+struct sieve_hit {
+    uint64_t q;    //cofactor of the next multiple
+    uint32_t d;    //divisor, >= seglen
+    uint32_t next; //rest of the bucket, SIEVE_NIL ends it
+};
+
+struct sieve {
+    uint64_t seglen;
+    uint64_t *sum;   //current segment
+    uint64_t *q;     //d < seglen: next cofactor in the window, 0 = done
+    uint64_t small;  //divisors 1..small-1 live in q[]
+    struct sieve_hit *hits;
+    size_t nhits, cap;
+    uint32_t bucket[SIEVE_WINDOW]; //per segment of the window
+};
+
+// one divisor pair of m = d*q: d == 1 pairs with m itself, which is not proper
+static inline void
+sieve_add(uint64_t *sum, uint64_t d, uint64_t q)
+{
+    uint64_t add = (d == 1) ? 1 : (q == d ? d : d + q);
+    if (__builtin_add_overflow(*sum, add, sum)) *sum = UINT64_MAX;
+}
+
+static void
+sieve_init(struct sieve *sv, uint64_t seglen)
+{
+    memset(sv, 0, sizeof(*sv));
+    sv->seglen = seglen;
+    sv->sum = malloc(sizeof(uint64_t) * seglen);
+    sv->q = malloc(sizeof(uint64_t) * seglen);
+    if (!sv->sum || !sv->q) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+sieve_free(struct sieve *sv)
+{
+    free(sv->sum);
+    free(sv->q);
+    free(sv->hits);
+}
+
+// first multiple m of d in [lo,hi] with m >= d*d (smaller ones pair with a
+// d' < d); returns its cofactor, or 0 if there is none
+static uint64_t
+sieve_first(uint64_t d, uint64_t lo, uint64_t hi)
+{
+    uint64_t off = (d - lo % d) % d;
+    if (off > hi - lo) return 0;
+    uint64_t m = lo + off;
+    if (m < d * d) m = d * d;
+    return m > hi ? 0 : m / d;
+}
+
+// set up the divisor state for the window [lo,hi] (at most SIEVE_WINDOW segments)
+static void
+sieve_window(struct sieve *sv, uint64_t lo, uint64_t hi)
+{
+    uint64_t r = isqrt(hi);
+    sv->small = r < sv->seglen ? r + 1 : sv->seglen;
+    for (uint64_t d = 1; d < sv->small; ++d) {
+        sv->q[d] = sieve_first(d, lo, hi);
+    }
+
+    for (int k = 0; k < SIEVE_WINDOW; ++k) {
+        sv->bucket[k] = SIEVE_NIL;
+    }
+    sv->nhits = 0;
+    for (uint64_t d = sv->small; d <= r; ++d) {
+        uint64_t q = sieve_first(d, lo, hi);
+        if (q == 0) continue;
+        if (sv->nhits == sv->cap) {
+            sv->cap = sv->cap ? sv->cap * 2 : 1024;
+            sv->hits = realloc(sv->hits, sizeof(*sv->hits) * sv->cap);
+            if (!sv->hits) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+        uint64_t k = (q * d - lo) / sv->seglen;
+        sv->hits[sv->nhits] = (struct sieve_hit){ q, (uint32_t)d, sv->bucket[k] };
+        sv->bucket[k] = (uint32_t)sv->nhits++;
+    }
+}
+
+// sums for segment k of the window starting at wlo and ending at whi
+static void
+sieve_segment(struct sieve *sv, uint64_t wlo, uint64_t whi, int k)
+{
+    uint64_t lo = wlo + (uint64_t)k * sv->seglen;
+    uint64_t len = (whi - lo < sv->seglen - 1) ? whi - lo + 1 : sv->seglen;
+    uint64_t *sum = sv->sum;
+
+    for (uint64_t i = 0; i < len; ++i) {
+        sum[i] = 0;
+    }
+    for (uint64_t d = 1; d < sv->small; ++d) {
+        uint64_t q = sv->q[d];
+        if (q == 0 || q * d - lo >= len) continue;
+        uint64_t i = q * d - lo;
+        for (; i < len; i += d, ++q) {
+            sieve_add(&sum[i], d, q);
+        }
+        // i is past this segment; it may also be past the window (and 2^64)
+        sv->q[d] = (i > whi - lo) ? 0 : q;
+    }
+
+    uint32_t h = sv->bucket[k];
+    sv->bucket[k] = SIEVE_NIL;
+    while (h != SIEVE_NIL) {
+        struct sieve_hit *x = &sv->hits[h];
+        uint32_t next = x->next;
+        uint64_t i = x->q * x->d - lo;
+        sieve_add(&sum[i], x->d, x->q);
+        if (i + x->d <= whi - lo) {
+            // d >= seglen, so the next multiple lands in a later segment
+            uint64_t nk = (uint64_t)k + (i + x->d) / sv->seglen;
+            x->q++;
+            x->next = sv->bucket[nk];
+            sv->bucket[nk] = h;
+        }
+        h = next;
+    }
+}
+
+// numbers per sieve segment: half of L2 for the sums, never more than the range
+static uint64_t
+sieve_segment_len(uint64_t start, uint64_t end)
+{
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (l2 <= 0) l2 = DEFAULT_L2;
+    uint64_t len = (uint64_t)l2 / 2 / sizeof(uint64_t);
+    return end - start < len - 1 ? end - start + 1 : len;
+}
+
+/* Multi-precision naturals for the Lucas-Lehmer engine: little-endian
+   arrays of 64-bit limbs, lengths passed alongside. */
+typedef uint64_t limb_t;
+typedef unsigned __int128 dlimb_t;
+
+// r = a + b (an >= bn, r has an limbs); returns the carry out
+static limb_t
+mp_add(limb_t *r, const limb_t *a, size_t an, const limb_t *b, size_t bn)
+{
+    limb_t c = 0;
+    for (size_t i = 0; i < an; ++i) {
+        dlimb_t t = (dlimb_t)a[i] + (i < bn ? b[i] : 0) + c;
+        r[i] = (limb_t)t;
+        c = (limb_t)(t >> 64);
+    }
+    return c;
+}
+
+// r = a - b (an >= bn, r has an limbs); returns the borrow out
+static limb_t
+mp_sub(limb_t *r, const limb_t *a, size_t an, const limb_t *b, size_t bn)
+{
+    limb_t br = 0;
+    for (size_t i = 0; i < an; ++i) {
+        limb_t bi = i < bn ? b[i] : 0;
+        limb_t d = a[i] - bi - br;
+        br = (a[i] < bi) || (a[i] - bi < br);
+        r[i] = d;
+    }
+    return br;
+}
+
+// r[0..2n) = a^2, computing each cross product once and doubling
+static void
+mp_sqr_school(limb_t *r, const limb_t *a, size_t n)
+{
+    for (size_t i = 0; i < 2 * n; ++i) r[i] = 0;
+    for (size_t i = 0; i < n; ++i) {
+        limb_t c = 0;
+        for (size_t j = i + 1; j < n; ++j) {
+            dlimb_t t = (dlimb_t)a[i] * a[j] + r[i + j] + c;
+            r[i + j] = (limb_t)t;
+            c = (limb_t)(t >> 64);
+        }
+        r[i + n] = c;
+    }
+    limb_t top = 0; // double the cross products
+    for (size_t i = 0; i < 2 * n; ++i) {
+        limb_t v = r[i];
+        r[i] = (v << 1) | top;
+        top = v >> 63;
+    }
+    limb_t c = 0; // add the diagonal a[i]^2
+    for (size_t i = 0; i < n; ++i) {
+        dlimb_t sq = (dlimb_t)a[i] * a[i];
+        dlimb_t t = (dlimb_t)r[2 * i] + (limb_t)sq + c;
+        r[2 * i] = (limb_t)t;
+        t = (dlimb_t)r[2 * i + 1] + (limb_t)(sq >> 64) + (limb_t)(t >> 64);
+        r[2 * i + 1] = (limb_t)t;
+        c = (limb_t)(t >> 64);
+    }
+}
+
+// scratch limbs mp_sqr needs for an n-limb operand
+static size_t
+mp_sqr_scratch(size_t n)
+{
+    size_t need = 0;
+    while (n >= KARATSUBA_LIMBS) {
+        size_t l = n - n / 2;
+        need += 3 * (l + 1);
+        n = l + 1;
+    }
+    return need;
+}
+
+/* r[0..2n) = a^2. Karatsuba with a = x1*B^l + x0:
+   a^2 = x1^2 B^2l + ((x0+x1)^2 - x0^2 - x1^2) B^l + x0^2,
+   three half-size squarings instead of four. */
+static void
+mp_sqr(limb_t *r, const limb_t *a, size_t n, limb_t *scratch)
+{
+    if (n < KARATSUBA_LIMBS) {
+        mp_sqr_school(r, a, n);
+        return;
+    }
+    size_t h = n / 2, l = n - h;
+    limb_t *t = scratch;           // x0 + x1, l+1 limbs
+    limb_t *tt = t + (l + 1);      // (x0 + x1)^2, 2l+2 limbs
+    limb_t *next = tt + 2 * (l + 1);
+
+    mp_sqr(r, a, l, next);                 // x0^2 into r[0..2l)
+    mp_sqr(r + 2 * l, a + l, h, next);     // x1^2 into r[2l..2n)
+    t[l] = mp_add(t, a, l, a + l, h);
+    mp_sqr(tt, t, l + 1, next);
+    mp_sub(tt, tt, 2 * l + 2, r, 2 * l);
+    mp_sub(tt, tt, 2 * l + 2, r + 2 * l, 2 * h);
+    // the middle term 2*x0*x1 fits in n+1 limbs
+    mp_add(r + l, r + l, 2 * n - l, tt, n + 1);
+}
+
+// x mod (2^p - 1) for x < 2^2p held in 2n limbs, result in r[0..n)
+static void
+mp_mod_mersenne(limb_t *r, const limb_t *x, size_t n, unsigned p)
+{
+    size_t w = p / 64;
+    unsigned b = p % 64;
+    limb_t mask = b ? ((limb_t)1 << b) - 1 : ~(limb_t)0;
+
+    // 2^p == 1, so x = hi*2^p + lo == hi + lo
+    limb_t c = 0;
+    for (size_t i = 0; i < n; ++i) {
+        limb_t hi = b ? (x[i + w] >> b) | (i + w + 1 < 2 * n ? x[i + w + 1] << (64 - b) : 0)
+                      : x[i + w];
+        limb_t lo = i == n - 1 ? x[i] & mask : x[i];
+        dlimb_t t = (dlimb_t)lo + hi + c;
+        r[i] = (limb_t)t;
+        c = (limb_t)(t >> 64);
+    }
+    // the sum is below 2^(p+1): fold bit p back in once more
+    limb_t over = b ? r[n - 1] >> b : c;
+    r[n - 1] &= mask;
+    for (size_t i = 0; over && i < n; ++i) {
+        r[i] += over;
+        over = r[i] == 0;
+    }
+    // 2^p - 1 itself is 0
+    int all = 1;
+    for (size_t i = 0; all && i < n; ++i) {
+        all = r[i] == (i == n - 1 ? mask : ~(limb_t)0);
+    }
+    if (all) {
+        for (size_t i = 0; i < n; ++i) r[i] = 0;
+    }
+}
+
+// small primality check for exponents: M_p can only be prime for prime p
+static int
+is_prime_u32(unsigned p)
+{
+    if (p < 2) return 0;
+    for (unsigned d = 2; d * d <= p; ++d) {
+        if (p % d == 0) return 0;
+    }
+    return 1;
+}
+
+// Lucas-Lehmer: M_p = 2^p - 1 (p an odd prime) is prime iff s_(p-2) == 0
+static int
+lucas_lehmer(unsigned p)
+{
+    if (p == 2) return 1; // M_2 = 3, the test starts at odd p
+    size_t n = (p + 63) / 64;
+    limb_t *s = calloc(n, sizeof(limb_t));
+    limb_t *sq = malloc(2 * n * sizeof(limb_t));
+    limb_t *scratch = malloc((mp_sqr_scratch(n) + 1) * sizeof(limb_t));
+    if (!s || !sq || !scratch) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    limb_t mask = p % 64 ? ((limb_t)1 << (p % 64)) - 1 : ~(limb_t)0;
+    limb_t two = 2, one = 1;
+
+    s[0] = 4;
+    for (unsigned i = 0; i < p - 2; ++i) {
+        mp_sqr(sq, s, n, scratch);
+        mp_mod_mersenne(s, sq, n, p);
+        // s - 2 mod M_p; on borrow s < 2 and s - 2 + M_p = (s - 3) mod 2^p
+        if (mp_sub(s, s, n, &two, 1)) {
+            mp_sub(s, s, n, &one, 1);
+            s[n - 1] &= mask;
+        }
+    }
+    int prime = 1;
+    for (size_t i = 0; i < n; ++i) {
+        if (s[i]) prime = 0;
+    }
+    free(s);
+    free(sq);
+    free(scratch);
+    return prime;
+}
+
+// decimal digits of 2^(p-1) * (2^p - 1); caller frees
+static char *
+perfect_decimal(unsigned p)
+{
+    // bits p-1 .. 2p-2 set
+    size_t n = (2 * (size_t)p - 1 + 63) / 64;
+    limb_t *x = calloc(n, sizeof(limb_t));
+    // each 64-bit limb gives at most 20 digits
+    char *buf = malloc(n * 20 + 1);
+    if (!x || !buf) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t bit = p - 1; bit < 2 * (size_t)p - 1; ++bit) {
+        x[bit / 64] |= (limb_t)1 << (bit % 64);
+    }
+
+    // peel off 19 digits at a time, least significant group first
+    char *end = buf + n * 20, *d = end;
+    *d = '\0';
+    while (n > 0) {
+        limb_t rem = 0;
+        for (size_t i = n; i-- > 0;) {
+            dlimb_t cur = ((dlimb_t)rem << 64) | x[i];
+            x[i] = (limb_t)(cur / 10000000000000000000ull);
+            rem = (limb_t)(cur % 10000000000000000000ull);
+        }
+        while (n > 0 && x[n - 1] == 0) n--;
+        for (int k = 0; k < 19 && (n > 0 || rem); ++k) {
+            *--d = (char)('0' + rem % 10);
+            rem /= 10;
+        }
+    }
+    free(x);
+    memmove(buf, d, (size_t)(end - d) + 1);
+    return buf;
+}
+
+/* the range split into chunks; chunk i covers numbers
+   [start + i*chunk, start + (i+1)*chunk - 1] clipped to end */
+struct work {
+    uint64_t start;
+    uint64_t end;
+    uint64_t chunk;           //0 = static: one contiguous slice per thread
+    uint64_t nchunks;
+    uint64_t first;           //chunks below this were done by a resumed run
+    int threads;
+    enum engine engine;
+    perfect_fn test;          //trial engine: selected kernel
+    uint64_t seglen;          //sieve engine: numbers per segment
+    atomic_uint_fast64_t next; //dispenser: next unclaimed chunk index
+};
+
+/* the hits of one chunk, formatted; each thread publishes these on its
+   own singly linked list, in the ascending chunk order it claims them */
+struct hits {
+    struct hits *_Atomic next;
+    uint64_t chunk;
+    size_t len;
+    char text[];
+};
+
 // thread arguments to pass data
 struct targs {
     int tid; //threadid
-    uint64_t start; //start of range
-    uint64_t end; //end of range
+    struct work *work; //shared range and chunk dispenser
     int verbose;
-    pthread_mutex_t *out_mtx; //ptr to mutex to protect printf
+    double busy; //seconds from thread start until it ran out of work
+    uint64_t chunks; //chunks this thread processed
+    /* every chunk below low that this thread touched is published;
+       UINT64_MAX once it has run out of work */
+    atomic_uint_fast64_t low;
+    char *pending; //hits of the current chunk, thread private
+    size_t pending_len, pending_cap;
+    struct hits *last; //producer end of the list
+    struct hits *cursor; //merger end: last node already written out
+    const cpu_set_t *cpus; //pin to these CPUs, NULL = leave to the scheduler
+};
+
+static double
+now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+// bounds of chunk idx
+static void
+chunk_range(const struct work *w, uint64_t idx, uint64_t *s, uint64_t *e)
+{
+    if (w->chunk == 0) {
+        //static: remainder threads get base_chunk + 1 (the original split)
+        uint64_t total = w->end - w->start + 1; // inclusive range
+        uint64_t base_chunk = total / (uint64_t)w->threads;
+        uint64_t remainder = total % (uint64_t)w->threads;
+        *s = w->start + idx * base_chunk + (idx < remainder ? idx : remainder);
+        *e = *s + base_chunk + (idx < remainder ? 1 : 0) - 1;
+        return;
+    }
+    *s = w->start + idx * w->chunk;
+    *e = (w->end - *s < w->chunk - 1) ? w->end : *s + w->chunk - 1;
+}
+
+// next chunk for thread tid, or 0 when the range is exhausted
+static int
+claim_chunk(struct work *w, int tid, uint64_t *claimed, uint64_t *idx)
+{
+    if (w->chunk == 0) {
+        // static: thread i owns slice i only
+        if (*claimed > 0 || (uint64_t)tid < w->first) return 0;
+        *idx = (uint64_t)tid;
+    } else {
+        // dynamic: whoever is free takes the next chunk, so nobody idles
+        *idx = atomic_fetch_add_explicit(&w->next, 1, memory_order_relaxed);
+    }
+    return *idx < w->nchunks;
+}
+
+// record one perfect number, already formatted; no locks, no I/O
+static void
+report_text(struct targs *a, const char *text)
+{
+    size_t n = strlen(text);
+    if (a->pending_len + n + 1 > a->pending_cap) {
+        size_t cap = a->pending_cap ? a->pending_cap : 256;
+        while (cap < a->pending_len + n + 1) cap *= 2;
+        a->pending = realloc(a->pending, cap);
+        if (!a->pending) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        a->pending_cap = cap;
+    }
+    memcpy(a->pending + a->pending_len, text, n);
+    a->pending[a->pending_len + n] = '\n';
+    a->pending_len += n + 1;
+}
+
+static void
+report(struct targs *a, uint64_t n)
+{
+    char text[24];
+    snprintf(text, sizeof(text), "%" PRIu64, n);
+    report_text(a, text);
+}
+
+// trial-division engine over [s,e]
+static void
+scan_trial(struct targs *a, uint64_t s, uint64_t e)
+{
+    perfect_fn test = a->work->test;
+    for (uint64_t n = s; ; ++n) {
+        if (test(n)) {
+            report(a, n);
+        }
+        if (n == e) break; // e may be UINT64_MAX
+    }
+}
+
+// sieve engine over [s,e], one cache-sized segment at a time
+static void
+scan_sieve(struct targs *a, uint64_t s, uint64_t e, struct sieve *sv)
+{
+    uint64_t span = sv->seglen * SIEVE_WINDOW;
+    for (uint64_t wlo = s; ; wlo += span) {
+        uint64_t whi = (e - wlo < span - 1) ? e : wlo + span - 1;
+        sieve_window(sv, wlo, whi);
+        for (int k = 0; ; ++k) {
+            uint64_t lo = wlo + (uint64_t)k * sv->seglen;
+            uint64_t hi = (whi - lo < sv->seglen - 1) ? whi : lo + sv->seglen - 1;
+            sieve_segment(sv, wlo, whi, k);
+            for (uint64_t i = 0; i <= hi - lo; ++i) {
+                if (lo + i >= 2 && sv->sum[i] == lo + i) {
+                    report(a, lo + i);
+                }
+            }
+            if (hi == whi) break;
+        }
+        if (whi == e) break;
+    }
+}
+
+// Euclid-Euler engine: [s,e] are exponents p, 2^(p-1)(2^p-1) is perfect
+// iff 2^p - 1 is prime, and every even perfect number has that form
+static void
+scan_mersenne(struct targs *a, uint64_t s, uint64_t e)
+{
+    for (uint64_t p = s; p <= e; ++p) {
+        if (!is_prime_u32((unsigned)p)) continue;
+        double t0 = now();
+        int prime = lucas_lehmer((unsigned)p);
+        if (prime) {
+            char *text = perfect_decimal((unsigned)p);
+            report_text(a, text);
+            free(text);
+        }
+        if (a->verbose) {
+            fprintf(stderr, "perfect: t%d p=%" PRIu64 " %s %.6f s\n", a->tid, p,
+                    prime ? "prime" : "composite", now() - t0);
+        }
+    }
+}
+
+// hand the hits of chunk idx to the merger
+static void
+publish_hits(struct targs *a, uint64_t idx)
+{
+    if (a->pending_len == 0) return;
+    struct hits *h = malloc(sizeof(*h) + a->pending_len);
+    if (!h) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&h->next, NULL);
+    h->chunk = idx;
+    h->len = a->pending_len;
+    memcpy(h->text, a->pending, a->pending_len);
+    atomic_store_explicit(&a->last->next, h, memory_order_release);
+    a->last = h;
+    a->pending_len = 0;
+}
+
+/* Checkpoint of a scan: its parameters, the number of leading chunks
+   that are complete, and every result found in them. Only the merger
+   touches it, so workers pay nothing for it. */
+struct journal {
+    const char *path;
+    uint64_t done;
+    char *text; //results of chunks [0, done), one per line
+    size_t len, cap;
+    double written; //now() of the last rewrite
 };
 
+static void
+journal_append(struct journal *j, const char *text, size_t len)
+{
+    if (j->len + len > j->cap) {
+        size_t cap = j->cap ? j->cap : 4096;
+        while (cap < j->len + len) cap *= 2;
+        j->text = realloc(j->text, cap);
+        if (!j->text) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        j->cap = cap;
+    }
+    memcpy(j->text + j->len, text, len);
+    j->len += len;
+}
+
+// rewrite the journal crash-safely: fill a temp file, fsync, rename over,
+// then fsync the containing directory
+static int
+journal_write(struct journal *j, const struct work *w)
+{
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", j->path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        return -1;
+    }
+    fprintf(f, "%s\nstart %" PRIu64 "\nend %" PRIu64 "\nchunk %" PRIu64
+            "\nthreads %d\nengine %s\ndone %" PRIu64 "\n",
+            JOURNAL_MAGIC, w->start, w->end, w->chunk, w->threads,
+            engine_names[w->engine], j->done);
+    fwrite(j->text, 1, j->len, f);
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0) {
+        perror(tmp);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    if (rename(tmp, j->path) != 0) {
+        perror(j->path);
+        return -1;
+    }
+    // the rename itself only survives a crash once the directory is synced
+    char dir[4096];
+    const char *slash = strrchr(j->path, '/');
+    if (!slash) {
+        strcpy(dir, ".");
+    } else if (slash == j->path) {
+        strcpy(dir, "/");
+    } else {
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - j->path), j->path);
+    }
+    int dfd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (dfd < 0 || fsync(dfd) != 0) {
+        perror(dir);
+        if (dfd >= 0) close(dfd);
+        return -1;
+    }
+    close(dfd);
+    j->written = now();
+    return 0;
+}
+
+// read a journal back; fills the scan parameters and j->done/j->text
+static int
+journal_load(struct journal *j, uint64_t *start, uint64_t *end, uint64_t *chunk,
+             int *threads, enum engine *engine)
+{
+    FILE *f = fopen(j->path, "r");
+    if (!f) {
+        perror(j->path);
+        return -1;
+    }
+    char magic[64], name[16];
+    if (!fgets(magic, sizeof(magic), f) || strcmp(magic, JOURNAL_MAGIC "\n") != 0
+        || fscanf(f, "start %" SCNu64 " end %" SCNu64 " chunk %" SCNu64
+                  " threads %d engine %15s done %" SCNu64,
+                  start, end, chunk, threads, name, &j->done) != 6
+        || fgetc(f) != '\n') {
+        fprintf(stderr, "%s: not a perfect journal\n", j->path);
+        fclose(f);
+        return -1;
+    }
+    *engine = ENGINE_TRIAL;
+    for (size_t i = 0; i < sizeof(engine_names) / sizeof(engine_names[0]); ++i) {
+        if (strcmp(name, engine_names[i]) == 0) *engine = (enum engine)i;
+    }
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        journal_append(j, buf, n);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Write out every published chunk that no thread can still precede, in
+   chunk order. A chunk below every thread's low is complete, and with
+   the dispenser handing out ascending indices that also covers chunks
+   nobody has claimed yet. Returns 1 once all threads have finished and
+   everything is written. */
+static int
+merge_ready(struct targs *args, int threads, struct journal *j, FILE *out)
+{
+    uint64_t safe = UINT64_MAX;
+    for (int t = 0; t < threads; ++t) {
+        uint64_t low = atomic_load(&args[t].low);
+        if (low < safe) safe = low;
+    }
+
+    int wrote = 0;
+    for (;;) {
+        struct hits *best = NULL;
+        int bt = -1;
+        for (int t = 0; t < threads; ++t) {
+            struct hits *h = atomic_load_explicit(&args[t].cursor->next, memory_order_acquire);
+            if (h && h->chunk < safe && (!best || h->chunk < best->chunk)) {
+                best = h;
+                bt = t;
+            }
+        }
+        if (!best) break;
+        if (out) fwrite(best->text, 1, best->len, out);
+        if (j) journal_append(j, best->text, best->len);
+        // the old cursor has a successor, so the producer is done with it
+        free(args[bt].cursor);
+        args[bt].cursor = best;
+        wrote = 1;
+    }
+    if (wrote && out) fflush(out);
+    if (j) {
+        uint64_t nchunks = args[0].work->nchunks;
+        uint64_t done = safe < nchunks ? safe : nchunks;
+        if (done > j->done) j->done = done; //static threads may dip below
+    }
+    return safe == UINT64_MAX;
+}
+
 //thread function for thread executions
 static void *
 thread_func(void *arg)
 {
     struct targs *a = (struct targs *)arg;
+    struct work *w = a->work;
+    double t0 = now();
+    uint64_t idx;
+    struct sieve sv; //sieve segment and divisor state, private to this thread
+
+    if (a->cpus) {
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), a->cpus);
+        if (err != 0) {
+            fprintf(stderr, "perfect: t%d pthread_setaffinity_np: %s\n", a->tid, strerror(err));
+        }
+    }
+
+    if (w->engine == ENGINE_SIEVE) {
+        sieve_init(&sv, w->seglen);
+    }
+
     if (a->verbose) { // if verbose is enabled then write to stderr
-        fprintf(stderr, "perfect: t%d searching [%" PRIu64 ",%" PRIu64 "]\n",
-                a->tid, a->start, a->end);
-        //PRIu64 is the format to print uint64_t
+        fprintf(stderr, "perfect: t%d searching\n", a->tid);
     }
 
-    for (uint64_t n = a->start; n <= a->end; ++n) {
-        if (is_perfect(n)) {
-            // protect printf so lines don't interfere
-            pthread_mutex_lock(a->out_mtx); //lock mutex
-            printf("%" PRIu64 "\n", n); //print
-            fflush(stdout); // flush to ensure output is written
-            pthread_mutex_unlock(a->out_mtx); //unlock mutex
+    a->chunks = 0;
+    for (;;) {
+        // anything this thread claims next is at or above this bound
+        atomic_store(&a->low, w->chunk ? atomic_load(&w->next) : (uint64_t)a->tid);
+        if (!claim_chunk(w, a->tid, &a->chunks, &idx)) break;
+        uint64_t s, e;
+        chunk_range(w, idx, &s, &e);
+        a->chunks++;
+        if (s > e) continue; // empty static slice
+
+        if (w->engine == ENGINE_SIEVE) {
+            scan_sieve(a, s, e, &sv);
+        } else if (w->engine == ENGINE_MERSENNE) {
+            scan_mersenne(a, s, e);
+        } else {
+            scan_trial(a, s, e);
         }
+        publish_hits(a, idx);
     }
+    a->busy = now() - t0;
+    if (w->engine == ENGINE_SIEVE) {
+        sieve_free(&sv);
+    }
+    atomic_store(&a->low, UINT64_MAX);
 
     //if verbose print
     if (a->verbose) {
@@ -73,37 +952,411 @@ thread_func(void *arg)
 }
 
 
+// (re)arm the dispenser for a run with this many threads
+static void
+work_reset(struct work *w, int threads)
+{
+    uint64_t total = w->end - w->start + 1; // inclusive range
+    w->threads = threads;
+    w->nchunks = w->chunk == 0 ? (uint64_t)threads
+                               : total / w->chunk + (total % w->chunk ? 1 : 0);
+    atomic_init(&w->next, w->first);
+}
+
+/* One scan of w with the given threads: results stream to out (NULL
+   discards them), cpus[i] pins thread i when given. Returns wall
+   seconds, or -1 on failure. */
+static double
+run_scan(struct work *w, int threads, int verbose, struct journal *jp, FILE *out,
+         cpu_set_t *const *cpus)
+{
+    // allocate an array of pthread_t to hold tids
+    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
+    // thread arguments
+    struct targs *args = malloc(sizeof(struct targs) * threads);
+    if (!tids || !args) {
+        perror("malloc");
+        return -1;
+    }
+
+    for (int i = 0; i < threads; ++i) { //iterate per thread
+        args[i].tid = i; //thread id
+        args[i].work = w; //shared dispenser
+        args[i].verbose = verbose; //verbose
+        atomic_init(&args[i].low, w->first); //nothing published yet
+        args[i].pending = NULL;
+        args[i].pending_len = args[i].pending_cap = 0;
+        args[i].last = args[i].cursor = calloc(1, sizeof(struct hits)); //list head
+        args[i].cpus = cpus ? cpus[i] : NULL;
+        if (!args[i].last) {
+            perror("calloc");
+            return -1;
+        }
+    }
+
+    double t0 = now();
+    // Launch threads
+    for (int i = 0; i < threads; ++i) {
+        if (pthread_create(&tids[i], NULL, thread_func, &args[i]) != 0) {
+            perror("pthread_create");
+            return -1;
+        }
+    }
+
+    // stream results in ascending order while the threads work
+    struct timespec poll = { 0, MERGE_POLL_NS };
+    if (jp) jp->written = now();
+    while (!merge_ready(args, threads, jp, out)) {
+        if (jp && now() - jp->written >= JOURNAL_INTERVAL) {
+            journal_write(jp, w);
+        }
+        nanosleep(&poll, NULL);
+    }
+    double wall = now() - t0;
+    // final checkpoint: everything done, a resume just replays results
+    if (jp && journal_write(jp, w) != 0) {
+        wall = -1;
+    }
+
+    // join threads
+    for (int i = 0; i < threads; ++i) {
+        pthread_join(tids[i], NULL);
+        free(args[i].cursor);
+        free(args[i].pending);
+    }
+
+    // per-thread busy time shows how evenly the work was spread
+    if (verbose) {
+        for (int i = 0; i < threads; ++i) {
+            fprintf(stderr, "perfect: t%d busy %.3f s of %.3f s (%.0f%%), %" PRIu64 " chunks\n",
+                    i, args[i].busy, now() - t0, wall > 0 ? 100.0 * args[i].busy / wall : 0.0,
+                    args[i].chunks);
+        }
+    }
+
+    free(tids); // free array of tids
+    free(args); // free struct args
+    return wall;
+}
+
+// how benchmark threads are placed
+enum pin { PIN_NONE = 0, PIN_CORES, PIN_SMT, PIN_NUMA };
+static const char *pin_names[] = { "none", "cores", "smt", "numa" };
+
+// where one logical CPU sits
+struct cpu_topo {
+    int cpu;
+    int package;
+    int core;
+    int node;
+    int thread; //rank among the SMT siblings of its core
+};
+
+static int
+read_sysfs_int(const char *path, int fallback)
+{
+    FILE *f = fopen(path, "r");
+    int v;
+    if (!f) return fallback;
+    if (fscanf(f, "%d", &v) != 1) v = fallback;
+    fclose(f);
+    return v;
+}
+
+// NUMA node of cpu: sysfs links cpuN/nodeM; 0 when there is no NUMA info
+static int
+cpu_node(int cpu)
+{
+    char path[128];
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d", cpu);
+    DIR *d = opendir(path);
+    int node = 0;
+    if (!d) return 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (strncmp(de->d_name, "node", 4) == 0) {
+            node = atoi(de->d_name + 4);
+            break;
+        }
+    }
+    closedir(d);
+    return node;
+}
+
+// topology of the CPUs we may run on; returns the count, -1 on error
+static int
+read_topology(struct cpu_topo **out)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        perror("sched_getaffinity");
+        return -1;
+    }
+    int n = 0;
+    struct cpu_topo *t = malloc(sizeof(*t) * CPU_COUNT(&allowed));
+    if (!t) {
+        perror("malloc");
+        return -1;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE && n < CPU_COUNT(&allowed); ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        char path[128];
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+        t[n].package = read_sysfs_int(path, 0);
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/core_id", cpu);
+        t[n].core = read_sysfs_int(path, cpu); // unknown: every CPU its own core
+        t[n].node = cpu_node(cpu);
+        t[n].cpu = cpu;
+        t[n].thread = 0;
+        for (int k = 0; k < n; ++k) {
+            if (t[k].package == t[n].package && t[k].core == t[n].core) t[n].thread++;
+        }
+        n++;
+    }
+    *out = t;
+    return n;
+}
+
+static enum pin pin_order; //sort key for cmp_topo
+static int
+cmp_topo(const void *pa, const void *pb)
+{
+    const struct cpu_topo *a = pa, *b = pb;
+    // cores: one thread of every core first, SMT siblings only after
+    if (pin_order == PIN_CORES && a->thread != b->thread) return a->thread - b->thread;
+    if (a->package != b->package) return a->package - b->package;
+    if (a->core != b->core) return a->core - b->core;
+    // smt: siblings of a core are adjacent
+    if (a->thread != b->thread) return a->thread - b->thread;
+    return a->cpu - b->cpu;
+}
+
+/* CPU set per thread for mode: cores and smt pin thread i to one logical
+   CPU in their fill order; numa pins thread i to all CPUs of node i mod
+   nodes, so memory stays local but the node's scheduler balances. */
+static cpu_set_t **
+placement(enum pin mode, struct cpu_topo *topo, int ncpu, int threads)
+{
+    if (mode == PIN_NONE) return NULL;
+    cpu_set_t **sets = malloc(sizeof(cpu_set_t *) * threads);
+    if (!sets) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    pin_order = mode;
+    qsort(topo, ncpu, sizeof(*topo), cmp_topo);
+
+    int nodes[CPU_SETSIZE], nnodes = 0;
+    for (int k = 0; k < ncpu; ++k) {
+        int seen = 0;
+        for (int m = 0; m < nnodes; ++m) seen |= nodes[m] == topo[k].node;
+        if (!seen) nodes[nnodes++] = topo[k].node;
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        sets[i] = malloc(sizeof(cpu_set_t));
+        if (!sets[i]) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        CPU_ZERO(sets[i]);
+        if (mode == PIN_NUMA) {
+            for (int k = 0; k < ncpu; ++k) {
+                if (topo[k].node == nodes[i % nnodes]) CPU_SET(topo[k].cpu, sets[i]);
+            }
+        } else {
+            CPU_SET(topo[i % ncpu].cpu, sets[i]);
+        }
+    }
+    return sets;
+}
+
+static void
+free_placement(cpu_set_t **sets, int threads)
+{
+    if (!sets) return;
+    for (int i = 0; i < threads; ++i) free(sets[i]);
+    free(sets);
+}
+
+/* Thread-scaling sweep over the same work: 1, 2, 4, ... threads up to
+   max (0 = every CPU we may use). Results are discarded; the table goes
+   to stdout, with speedup relative to the 1-thread run. */
+static int
+bench_scaling(struct work *w, int max, enum pin mode, int verbose)
+{
+    struct cpu_topo *topo;
+    int ncpu = read_topology(&topo);
+    if (ncpu < 0) return EXIT_FAILURE;
+    if (max <= 0) max = ncpu;
+
+    uint64_t numbers = w->end - w->start + 1;
+    double base = 0;
+    printf("%7s %6s %10s %8s %10s %14s\n",
+           "threads", "pin", "wall_s", "speedup", "efficiency", "numbers/s");
+    for (int t = 1; ; t = t * 2 < max ? t * 2 : max) {
+        cpu_set_t **sets = placement(mode, topo, ncpu, t);
+        work_reset(w, t);
+        double wall = run_scan(w, t, verbose, NULL, NULL, sets);
+        free_placement(sets, t);
+        if (wall < 0) {
+            free(topo);
+            return EXIT_FAILURE;
+        }
+        if (t == 1) base = wall;
+        double speedup = wall > 0 ? base / wall : 0;
+        printf("%7d %6s %10.3f %8.2f %9.0f%% %14.0f\n", t, pin_names[mode], wall,
+               speedup, 100.0 * speedup / t, wall > 0 ? (double)numbers / wall : 0);
+        fflush(stdout);
+        if (t == max) break;
+    }
+    free(topo);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     uint64_t start = 1; //default start = 1
     uint64_t end = 10000; //default end = 10000
     int threads = 1; //one thread default
     int verbose = 0;
+    uint64_t chunk = DEFAULT_CHUNK; //numbers per claim, 0 = static slices
+    int chunk_set = 0;
+    int start_set = 0;
+    int end_set = 0;
+    int engine_set = 0;
+    enum engine engine = ENGINE_TRIAL;
+    const char *kernel_name = "auto";
+    struct journal journal = { 0 };
+    const char *resume = NULL;
+    int bench = 0;
+    int threads_set = 0;
+    enum pin pin = PIN_NONE;
+
+    static const struct option longopts[] = {
+        { "journal", required_argument, NULL, 'J' },
+        { "resume",  required_argument, NULL, 'R' },
+        { "bench",   no_argument,       NULL, 'b' },
+        { "pin",     required_argument, NULL, 'p' },
+        { NULL, 0, NULL, 0 }
+    };
 
     // parse through the options
     int opt;
-    while ((opt = getopt(argc, argv, "s:e:t:v")) != -1) {
+    while ((opt = getopt_long(argc, argv, "s:e:t:c:SMK:v", longopts, NULL)) != -1) {
         switch (opt) {
         case 's':
             //using strtoull parse optarg into uint64_t
             start = strtoull(optarg, NULL, 10);
+            start_set = 1;
             break;
         case 'e':
             //using strtoull parse optarg into uint64_t
             end = strtoull(optarg, NULL, 10);
+            end_set = 1;
             break;
         case 't':
             //parse thread count using strtol
             threads = (int)strtol(optarg, NULL, 10);
+            threads_set = 1;
+            break;
+        case 'c':
+            //chunk size for the dispenser, 0 restores the static split
+            chunk = strtoull(optarg, NULL, 10);
+            chunk_set = 1;
+            break;
+        case 'S':
+            //segmented divisor-sum sieve instead of trial division
+            engine = ENGINE_SIEVE;
+            engine_set = 1;
+            break;
+        case 'M':
+            //-s/-e become exponents p, tested with Lucas-Lehmer
+            engine = ENGINE_MERSENNE;
+            engine_set = 1;
+            break;
+        case 'K':
+            //trial-division kernel: auto, avx512, avx2 or scalar
+            kernel_name = optarg;
             break;
         case 'v':
             verbose = 1;
             break;
+        case 'J':
+            //checkpoint completed chunks and their results to this file
+            journal.path = optarg;
+            break;
+        case 'R':
+            //continue the scan recorded in this journal, and keep it updated
+            resume = optarg;
+            break;
+        case 'b':
+            //thread-scaling sweep up to -t (default: all CPUs), no results
+            bench = 1;
+            break;
+        case 'p':
+            //thread placement: none, cores, smt or numa
+            pin = PIN_NONE;
+            while (pin <= PIN_NUMA && strcmp(optarg, pin_names[pin]) != 0) pin++;
+            if (pin > PIN_NUMA) {
+                fprintf(stderr, "Unknown placement: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
         default:
             argv[0];
         }
     }
     
+    // a resumed scan takes its parameters from the journal
+    uint64_t first = 0;
+    if (resume) {
+        struct journal old = { .path = resume };
+        uint64_t jstart, jend, jchunk;
+        int jthreads;
+        enum engine jengine;
+        if (journal_load(&old, &jstart, &jend, &jchunk, &jthreads, &jengine) != 0) {
+            return EXIT_FAILURE;
+        }
+        // flags repeating the journal are fine, anything else would be ignored
+        if ((start_set && start != jstart) || (end_set && end != jend)
+            || (chunk_set && chunk != jchunk) || (engine_set && engine != jengine)
+            || (jchunk == 0 && threads_set && threads != jthreads)) {
+            fprintf(stderr, "%s: journal scans %" PRIu64 "..%" PRIu64 " with the %s engine, "
+                    "chunk %" PRIu64, resume, jstart, jend, engine_names[jengine], jchunk);
+            if (jchunk == 0) fprintf(stderr, " (static slices for %d threads)", jthreads);
+            fprintf(stderr, "; -s/-e/-c/-S/-M%s cannot change that on --resume\n",
+                    jchunk == 0 ? "/-t" : "");
+            free(old.text);
+            return EXIT_FAILURE;
+        }
+        start = jstart;
+        end = jend;
+        engine = jengine;
+        chunk = jchunk;
+        chunk_set = end_set = 1;
+        if (chunk == 0) threads = jthreads; //static slices depend on it
+        first = old.done;
+        if (!journal.path) journal.path = resume;
+        journal.done = old.done;
+        journal.text = old.text;
+        journal.len = old.len;
+        journal.cap = old.cap;
+        // results already found come first, as in the original run
+        fwrite(journal.text, 1, journal.len, stdout);
+        fflush(stdout);
+    }
+
+    if (engine == ENGINE_MERSENNE) {
+        if (!end_set) end = DEFAULT_PMAX;
+        if (end > MAX_EXPONENT) {
+            fprintf(stderr, "Invalid exponent: must be <= %u\n", MAX_EXPONENT);
+            return EXIT_FAILURE;
+        }
+        //exponent cost grows fast, so hand them out one at a time
+        if (!chunk_set) chunk = 1;
+    }
+
     // ensure start is atleast 1 and end is not smaller than start
     if (start < 1 || end < start) {
         fprintf(stderr, "Invalid range: start must be >=1 and end >= start\n");
@@ -115,54 +1368,55 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    // create threads and assign contiguous subranges
-
-    // allocate an array of pthread_t to hold tids
-    pthread_t *tids = malloc(sizeof(pthread_t) * threads);
-    // thread arguments
-    struct targs *args = malloc(sizeof(struct targs) * threads);
-    pthread_mutex_t out_mtx; // protect output
-    pthread_mutex_init(&out_mtx, NULL); // initialize mutex
-
-    uint64_t total = end - start + 1; // inclusive range
-    uint64_t base_chunk = total / (uint64_t)threads; // integer division 
-    uint64_t remainder = total % (uint64_t)threads; // not evenly divisible integers
-
-    uint64_t cur = start;
-    for (int i = 0; i < threads; ++i) { //iterate per thread
-        //remainder threads get base_chunk + 1
-        uint64_t chunk = base_chunk + (i < (int)remainder ? 1 : 0);
-        uint64_t s = cur;
-        uint64_t e = cur + chunk - 1;
-
-        //storing
-        args[i].tid = i; //thread id
-        args[i].start = s; //start of range
-        args[i].end = e; //end of range
-        args[i].verbose = verbose; //verbose
-        args[i].out_mtx = &out_mtx; // share ptr to mutex
-
-        cur += chunk;
+    const struct kernel *kernel = pick_kernel(kernel_name);
+    if (!kernel) {
+        fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernel_name);
+        return EXIT_FAILURE;
+    }
+    if (verbose && engine == ENGINE_TRIAL) {
+        fprintf(stderr, "perfect: %s kernel\n", kernel->name);
     }
 
-    // Launch threads
-    for (int i = 0; i < threads; ++i) {
-        if (args[i].start > args[i].end) {
-            // empty range; create thread that will immediately finish
-        }
-        if (pthread_create(&tids[i], NULL, thread_func, &args[i]) != 0) {
-            perror("pthread_create");
-            return EXIT_FAILURE;
+    // shared range: threads claim chunks from it instead of fixed subranges
+    struct work work = {
+        .start = start,
+        .end = end,
+        .chunk = chunk,
+        .threads = threads,
+        .engine = engine,
+        .test = kernel->test,
+        .first = first,
+    };
+    if (engine == ENGINE_SIEVE) {
+        work.seglen = sieve_segment_len(start, end);
+        //by default one claim is sqrt(end) numbers, so the first-multiple
+        //divisions stay a small share of it, but at most one window
+        if (!chunk_set) {
+            uint64_t r = isqrt(end), span = work.seglen * SIEVE_WINDOW;
+            work.chunk = chunk = r < work.seglen ? work.seglen : (r > span ? span : r);
         }
     }
+    work_reset(&work, threads);
+    if (verbose && resume) {
+        fprintf(stderr, "perfect: resuming at chunk %" PRIu64 " of %" PRIu64 "\n",
+                first, work.nchunks);
+    }
 
-    // join threads
-    for (int i = 0; i < threads; ++i) {
-        pthread_join(tids[i], NULL);
+    if (bench) {
+        return bench_scaling(&work, threads_set ? threads : 0, pin, verbose);
     }
 
-    pthread_mutex_destroy(&out_mtx); // destroy mutex
-    free(tids); // free array of tids
-    free(args); // free struct args
-    return 0;
+    cpu_set_t **sets = NULL;
+    if (pin != PIN_NONE) {
+        struct cpu_topo *topo;
+        int ncpu = read_topology(&topo);
+        if (ncpu < 0) return EXIT_FAILURE;
+        sets = placement(pin, topo, ncpu, threads);
+        free(topo);
+    }
+    double wall = run_scan(&work, threads, verbose, journal.path ? &journal : NULL,
+                           stdout, sets);
+    free_placement(sets, threads);
+    free(journal.text);
+    return wall < 0 ? EXIT_FAILURE : 0;
 }
@@ -5,44 +5,340 @@ Operating Systems
 Redon Jashari 
 */
 
+#define _GNU_SOURCE
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
 #include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-int reapall(void)
+#include "reap_processes.h"
+
+#define SUP_EVENTS 64 // epoll events fetched per sup_wait() round
+
+struct supervisor {
+    int epfd;
+    int sigfd;          // -1 in pidfd mode
+    int watched;        // pidfds currently in the epoll set
+    int pending;        // signalfd mode: more exits may be ready than fit the last batch
+    sigset_t oldmask;   // signalfd mode: mask to restore
+    int *fds;           // pidfd mode: pidfd per slot, -1 when free
+    int *free_slots;    // stack of free slot numbers
+    int nfree;
+    int used;           // slots handed out so far
+    int cap;
+};
+
+// slot for a new pidfd in O(1) amortized; -1 if out of memory
+static int slot_get(supervisor_t *sup)
 {
-    int status;
-    pid_t pid;
-    int normal_count = 0;
+    if (sup->nfree > 0) {
+        return sup->free_slots[--sup->nfree];
+    }
+    if (sup->used == sup->cap) {
+        int cap = sup->cap ? sup->cap * 2 : SUP_EVENTS;
+        int *fds = realloc(sup->fds, sizeof(int) * (size_t)cap);
+        if (!fds) {
+            return -1;
+        }
+        sup->fds = fds;
+        int *free_slots = realloc(sup->free_slots, sizeof(int) * (size_t)cap);
+        if (!free_slots) {
+            return -1;
+        }
+        sup->free_slots = free_slots;
+        sup->cap = cap;
+    }
+    return sup->used++;
+}
 
+static void slot_put(supervisor_t *sup, int slot)
+{
+    sup->fds[slot] = -1;
+    sup->free_slots[sup->nfree++] = slot;
+}
+
+static int pidfd_open(pid_t pid, unsigned int flags)
+{
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, flags);
+#else
+    (void)pid;
+    (void)flags;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+// wait4 one child (or any with pid -1) without blocking; 1 = reaped, 0 = none, -1 = error
+static int reap_one(pid_t pid, child_exit_t *out)
+{
     for (;;) {
-        pid = waitpid(-1, &status, WNOHANG);
-        if (pid > 0) {
-            // A child process was reaped
-            if (WIFEXITED(status)) {
-                normal_count++;
-            }
-            continue;
+        pid_t got = wait4(pid, &out->status, WNOHANG, &out->ru);
+        if (got > 0) {
+            out->pid = got;
+            clock_gettime(CLOCK_MONOTONIC, &out->when);
+            return 1;
         }
-
-        if (pid == 0) {
+        if (got == 0) {
             // children exist but none have exited right now
-            break;
+            return 0;
         }
-
-        // if pid == -1 then error or no children processes
         if (errno == EINTR) {
             // interrupted by signal, retry
             continue;
         }
         if (errno == ECHILD) {
             // no child processes
+            return 0;
+        }
+        return -1;
+    }
+}
+
+// collect up to max already-exited children of any pid; returns count or -1
+static int reap_ready(child_exit_t *out, int max)
+{
+    int n = 0;
+    while (n < max) {
+        int r = reap_one(-1, &out[n]);
+        if (r < 0) {
+            return -1;
+        }
+        if (r == 0) {
             break;
         }
+        n++;
+    }
+    return n;
+}
+
+supervisor_t *sup_create(void)
+{
+    supervisor_t *sup = calloc(1, sizeof(*sup));
+    if (!sup) {
+        return NULL;
+    }
+    sup->sigfd = -1;
+    sup->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (sup->epfd < 0) {
+        free(sup);
+        return NULL;
+    }
+
+    // probe for pidfd support on ourselves
+    int probe = pidfd_open(getpid(), 0);
+    if (probe >= 0) {
+        close(probe);
+        return sup;
+    }
+
+    // fallback: SIGCHLD through a signalfd in the same epoll set
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    if (pthread_sigmask(SIG_BLOCK, &chld, &sup->oldmask) != 0) {
+        goto fail;
+    }
+    sup->sigfd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sup->sigfd < 0) {
+        pthread_sigmask(SIG_SETMASK, &sup->oldmask, NULL);
+        goto fail;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = UINT64_MAX };
+    if (epoll_ctl(sup->epfd, EPOLL_CTL_ADD, sup->sigfd, &ev) < 0) {
+        close(sup->sigfd);
+        pthread_sigmask(SIG_SETMASK, &sup->oldmask, NULL);
+        goto fail;
+    }
+    // children that exited before the mask went up sent no signal we can read
+    sup->pending = 1;
+    return sup;
+
+fail:
+    close(sup->epfd);
+    free(sup);
+    return NULL;
+}
 
-        // error, return -1
+int sup_watch(supervisor_t *sup, pid_t pid)
+{
+    if (sup->sigfd >= 0) {
+        return 0;
+    }
+    int slot = slot_get(sup);
+    if (slot < 0) {
         return -1;
     }
+    int fd = pidfd_open(pid, 0); // pidfds are always close-on-exec
+    if (fd < 0) {
+        slot_put(sup, slot);
+        return -1;
+    }
+    sup->fds[slot] = fd;
+    // pid and slot travel with the event, so an exit needs no lookup
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data.u64 = ((uint64_t)(uint32_t)pid << 32) | (uint32_t)slot,
+    };
+    if (epoll_ctl(sup->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        close(fd);
+        slot_put(sup, slot);
+        return -1;
+    }
+    sup->watched++;
+    return 0;
+}
+
+int sup_wait(supervisor_t *sup, child_exit_t *out, int max, int timeout_ms)
+{
+    int n = 0;
+    if (max <= 0) {
+        return 0;
+    }
+
+    if (sup->sigfd >= 0) {
+        // no children at all: nothing will ever become readable
+        siginfo_t info;
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0 && errno == ECHILD) {
+            return 0;
+        }
+        if (sup->pending) {
+            n = reap_ready(out, max);
+            if (n < 0) {
+                return -1;
+            }
+            sup->pending = (n == max);
+            if (n > 0) {
+                return n;
+            }
+        }
+    } else if (sup->watched == 0) {
+        // nothing registered, nothing will ever become readable
+        return 0;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // a wakeup can yield nothing (signals for children already reaped), so wait again
+    while (n == 0) {
+        int wait_ms = timeout_ms;
+        if (timeout_ms > 0) {
+            struct timespec t;
+            clock_gettime(CLOCK_MONOTONIC, &t);
+            long spent = (t.tv_sec - start.tv_sec) * 1000L + (t.tv_nsec - start.tv_nsec) / 1000000L;
+            wait_ms = spent >= timeout_ms ? 0 : timeout_ms - (int)spent;
+        }
+
+        struct epoll_event ev[SUP_EVENTS];
+        int ne = epoll_wait(sup->epfd, ev, max < SUP_EVENTS ? max : SUP_EVENTS, wait_ms);
+        if (ne < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (ne == 0) {
+            // timed out
+            return 0;
+        }
+
+        for (int i = 0; i < ne && n < max; ++i) {
+            if (ev[i].data.u64 == UINT64_MAX) {
+                // signalfd: drain it, SIGCHLDs coalesce so reap until none are left
+                struct signalfd_siginfo si;
+                while (read(sup->sigfd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {
+                }
+                int r = reap_ready(out + n, max - n);
+                if (r < 0) {
+                    return -1;
+                }
+                n += r;
+                sup->pending = (n == max);
+                continue;
+            }
+
+            pid_t pid = (pid_t)(ev[i].data.u64 >> 32);
+            int slot = (int)(uint32_t)ev[i].data.u64;
+            int r = reap_one(pid, &out[n]);
+            if (r < 0) {
+                return -1;
+            }
+            epoll_ctl(sup->epfd, EPOLL_CTL_DEL, sup->fds[slot], NULL);
+            close(sup->fds[slot]);
+            slot_put(sup, slot);
+            sup->watched--;
+            n += r;
+        }
+
+        if (sup->sigfd < 0 && sup->watched == 0) {
+            break;
+        }
+        if (timeout_ms == 0) {
+            break;
+        }
+    }
+    return n;
+}
+
+int sup_fd(const supervisor_t *sup)
+{
+    return sup->epfd;
+}
+
+int sup_uses_pidfd(const supervisor_t *sup)
+{
+    return sup->sigfd < 0;
+}
+
+void sup_destroy(supervisor_t *sup)
+{
+    if (!sup) {
+        return;
+    }
+    if (sup->sigfd >= 0) {
+        close(sup->sigfd);
+        pthread_sigmask(SIG_SETMASK, &sup->oldmask, NULL);
+    }
+    // pidfds still registered in pidfd mode
+    for (int i = 0; i < sup->used; ++i) {
+        if (sup->fds[i] >= 0) {
+            close(sup->fds[i]);
+        }
+    }
+    close(sup->epfd);
+    free(sup->fds);
+    free(sup->free_slots);
+    free(sup);
+}
+
+int reapall(void)
+{
+    child_exit_t batch[SUP_EVENTS];
+    int normal_count = 0;
+
+    for (;;) {
+        int n = reap_ready(batch, SUP_EVENTS);
+        if (n < 0) {
+            // error, return -1
+            return -1;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (WIFEXITED(batch[i].status)) {
+                normal_count++;
+            }
+        }
+        if (n < SUP_EVENTS) {
+            break;
+        }
+    }
     // returns # of children that terminated normally
     return normal_count;
 }
@@ -0,0 +1,66 @@
+/*
+ * reap_processes.h --
+ */
+#ifndef REAP_PROCESSES_H
+#define REAP_PROCESSES_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/* one reaped child */
+typedef struct {
+    pid_t pid;              /* process id of the child */
+    int status;             /* wait status, use the W* macros */
+    struct rusage ru;       /* resources used by the child */
+    struct timespec when;   /* CLOCK_MONOTONIC time the exit was collected */
+} child_exit_t;
+
+/* opaque supervisor state, see below */
+typedef struct supervisor supervisor_t;
+
+/*
+ * Create a supervisor. It uses one pidfd per watched child in an
+ * epoll set when the kernel has pidfd_open (Linux 5.3), otherwise it
+ * blocks SIGCHLD in the calling thread and waits on a signalfd. The
+ * mode is reported by sup_uses_pidfd(). Returns NULL on error.
+ */
+extern supervisor_t* sup_create(void);
+
+/*
+ * Register a child to be supervised. Required in pidfd mode, where
+ * only registered children are reaped; a no-op in signalfd mode,
+ * where every child of the process is reaped. Returns 0 or -1.
+ */
+extern int sup_watch(supervisor_t *sup, pid_t pid);
+
+/*
+ * Wait up to timeout_ms (-1 = forever, 0 = poll) for children to
+ * exit and reap at most max of them into out. Each exit costs O(1);
+ * there is no polling. Returns the number of records filled, 0 on
+ * timeout or when nothing is left to wait for, -1 on error.
+ */
+extern int sup_wait(supervisor_t *sup, child_exit_t *out, int max, int timeout_ms);
+
+/*
+ * The epoll descriptor, readable whenever sup_wait() would not block.
+ * Lets a caller put the supervisor into its own event loop.
+ */
+extern int sup_fd(const supervisor_t *sup);
+
+/* 1 in pidfd mode, 0 in signalfd mode */
+extern int sup_uses_pidfd(const supervisor_t *sup);
+
+/* Close all descriptors and restore the SIGCHLD mask. */
+extern void sup_destroy(supervisor_t *sup);
+
+/*
+ * Reap every child that has already exited without blocking and
+ * return how many of them terminated normally, or -1 on error.
+ * Compatibility wrapper over the supervisor's reap loop.
+ *
+ * Implemented in reap_processes.c
+ */
+extern int reapall(void);
+
+#endif /* REAP_PROCESSES_H */
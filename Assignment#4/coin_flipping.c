@@ -4,6 +4,7 @@ Operating Systems
 Redon Jashari 
 */
 
+#define _GNU_SOURCE // RUSAGE_THREAD
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,23 +12,373 @@ Redon Jashari
 #include <pthread.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
 
-#define COIN_COUNT 20
-static char coins[COIN_COUNT + 1]; // +1 for '\0'
+#define COIN_COUNT 20 // default table size, -C changes it
+#define CACHE_LINE 64
+static char *coins; // C coins + '\0'
+static char *start_coins; // table before a run, for the check
+static int C = COIN_COUNT; // number of coins
 static int P = 100;       // number of persons / threads
 static int N = 10000;     // flips per person
+static int R = 1;         // trials per strategy
+static int H = 0;         // record lock wait/hold histograms
+static int S = 0;         // reader threads for the snapshot comparison
 
-static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t coin_locks[COIN_COUNT];
+#define SPIN_LIMIT 128 // spins before a waiter yields its CPU
+#define FC_SPINS 16 // flat combining: polls of our slot before combining ourselves
+
+/* Lock implementations behind every locked strategy, picked with -L.
+   Spinning waiters yield after SPIN_LIMIT tries: with 100 persons on a
+   few cores a pure spinner would burn whole time slices waiting for a
+   preempted holder. */
+enum lock_kind { LOCK_MUTEX, LOCK_TTAS, LOCK_TICKET, LOCK_MCS, LOCK_CLH, LOCK_FUTEX, NLOCKS };
+static const char *lock_names[NLOCKS] = { "mutex", "ttas", "ticket", "mcs", "clh", "futex" };
+static enum lock_kind lock_kind = LOCK_MUTEX;
+
+struct mcs_node {
+    _Atomic(struct mcs_node *) next;
+    atomic_int locked;
+};
+
+struct clh_node {
+    _Alignas(CACHE_LINE) atomic_int locked; // spun on by the successor
+};
+
+struct lock {
+    union {
+        pthread_mutex_t mutex;
+        atomic_int word; // ttas: 0/1; futex: 0 free, 1 locked, 2 contended
+        struct {
+            atomic_uint next, serving;
+        } ticket;
+        _Atomic(struct mcs_node *) mcs_tail;
+        _Atomic(struct clh_node *) clh_tail;
+    };
+};
+
+#define HIST_BUCKETS 64 // bucket b counts times in [2^(b-1), 2^b) ns
+
+struct hist {
+    uint64_t count[HIST_BUCKETS];
+    uint64_t n, sum, max; // ns
+};
+
+// per-person queue-lock state; one lock is held at a time, so one node each
+struct lock_ctx {
+    struct mcs_node mcs;
+    struct clh_node *clh_mine; // node we enqueue next
+    struct clh_node *clh_pred; // predecessor's node, ours after release
+    struct hist *wait, *hold;  // -H: this person's histograms, else NULL
+    uint64_t acquired;         // -H: when the held lock was taken, ns
+    int id;                    // person number, picks its combining slot
+};
+
+static struct lock table_lock;
+static struct lock *coin_locks; // C locks packed back to back, like coins[]
+
+/* padded layout: each coin next to its own lock on a private cache line,
+   so flipping coin j never invalidates the line holding coin j+1 */
+struct padded_lock_coin {
+    _Alignas(CACHE_LINE) struct lock lock;
+    char coin;
+};
+static struct padded_lock_coin *padded_locks;
+
+// lock-free representations: bit/byte set means the coin shows 'X'
+#define WORD_COINS 64 // coins that fit the packed word
+static _Atomic uint64_t coin_word;
+struct padded_coin {
+    _Alignas(CACHE_LINE) atomic_uchar v; // one coin per cache line
+};
+static struct padded_coin *padded_coins;
+
+// sharded layout: person p flips shards[p * shard_stride + j], merged at the end
+static char *shards;
+static size_t shard_stride; // C rounded up to whole cache lines
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// one round of a spin-wait loop: pause, and give the CPU away now and then
+static inline void spin_wait(int *spins) {
+    if (++*spins < SPIN_LIMIT) {
+        cpu_relax();
+    } else {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+static void futex_wait(atomic_int *addr, int val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(atomic_int *addr, int n) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+static struct clh_node *clh_node_new(void) {
+    struct clh_node *n = aligned_alloc(CACHE_LINE, sizeof(*n));
+    if (!n) {
+        perror("aligned_alloc");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&n->locked, 0);
+    return n;
+}
+
+static void lock_init(struct lock *l) {
+    switch (lock_kind) {
+    case LOCK_MUTEX:
+        pthread_mutex_init(&l->mutex, NULL);
+        break;
+    case LOCK_TTAS:
+    case LOCK_FUTEX:
+        atomic_init(&l->word, 0);
+        break;
+    case LOCK_TICKET:
+        atomic_init(&l->ticket.next, 0);
+        atomic_init(&l->ticket.serving, 0);
+        break;
+    case LOCK_MCS:
+        atomic_init(&l->mcs_tail, NULL);
+        break;
+    case LOCK_CLH:
+        atomic_init(&l->clh_tail, clh_node_new()); // unlocked dummy
+        break;
+    default:
+        break;
+    }
+}
+
+static void lock_destroy(struct lock *l) {
+    if (lock_kind == LOCK_MUTEX) {
+        pthread_mutex_destroy(&l->mutex);
+    } else if (lock_kind == LOCK_CLH) {
+        // the last released node is left in the tail and owned by nobody
+        free(atomic_load(&l->clh_tail));
+    }
+}
+
+static void lock_acquire_raw(struct lock *l, struct lock_ctx *ctx) {
+    int spins = 0;
+    switch (lock_kind) {
+    case LOCK_MUTEX:
+        pthread_mutex_lock(&l->mutex);
+        break;
+    case LOCK_TTAS:
+        for (;;) {
+            // spin on a plain load so waiters share the line until it frees
+            while (atomic_load_explicit(&l->word, memory_order_relaxed)) {
+                spin_wait(&spins);
+            }
+            if (!atomic_exchange_explicit(&l->word, 1, memory_order_acquire)) break;
+        }
+        break;
+    case LOCK_TICKET: {
+        unsigned me = atomic_fetch_add_explicit(&l->ticket.next, 1, memory_order_relaxed);
+        while (atomic_load_explicit(&l->ticket.serving, memory_order_acquire) != me) {
+            spin_wait(&spins);
+        }
+        break;
+    }
+    case LOCK_MCS: {
+        struct mcs_node *me = &ctx->mcs;
+        atomic_store_explicit(&me->next, NULL, memory_order_relaxed);
+        atomic_store_explicit(&me->locked, 1, memory_order_relaxed);
+        struct mcs_node *pred = atomic_exchange_explicit(&l->mcs_tail, me, memory_order_acq_rel);
+        if (pred) {
+            atomic_store_explicit(&pred->next, me, memory_order_release);
+            // each waiter spins on its own node
+            while (atomic_load_explicit(&me->locked, memory_order_acquire)) {
+                spin_wait(&spins);
+            }
+        }
+        break;
+    }
+    case LOCK_CLH: {
+        struct clh_node *me = ctx->clh_mine;
+        atomic_store_explicit(&me->locked, 1, memory_order_relaxed);
+        struct clh_node *pred = atomic_exchange_explicit(&l->clh_tail, me, memory_order_acq_rel);
+        while (atomic_load_explicit(&pred->locked, memory_order_acquire)) {
+            spin_wait(&spins);
+        }
+        ctx->clh_pred = pred;
+        break;
+    }
+    case LOCK_FUTEX: {
+        // Drepper's three-state mutex: sleep in the kernel only when contended
+        int c = 0;
+        if (atomic_compare_exchange_strong(&l->word, &c, 1)) break;
+        if (c != 2) c = atomic_exchange(&l->word, 2);
+        while (c != 0) {
+            futex_wait(&l->word, 2);
+            c = atomic_exchange(&l->word, 2);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void lock_release_raw(struct lock *l, struct lock_ctx *ctx) {
+    switch (lock_kind) {
+    case LOCK_MUTEX:
+        pthread_mutex_unlock(&l->mutex);
+        break;
+    case LOCK_TTAS:
+        atomic_store_explicit(&l->word, 0, memory_order_release);
+        break;
+    case LOCK_TICKET:
+        atomic_fetch_add_explicit(&l->ticket.serving, 1, memory_order_release);
+        break;
+    case LOCK_MCS: {
+        struct mcs_node *me = &ctx->mcs;
+        struct mcs_node *next = atomic_load_explicit(&me->next, memory_order_acquire);
+        if (!next) {
+            struct mcs_node *expect = me;
+            if (atomic_compare_exchange_strong_explicit(&l->mcs_tail, &expect, NULL,
+                                                        memory_order_acq_rel,
+                                                        memory_order_relaxed)) {
+                break; // nobody waiting
+            }
+            // a successor swapped the tail but has not linked in yet
+            int spins = 0;
+            while (!(next = atomic_load_explicit(&me->next, memory_order_acquire))) {
+                spin_wait(&spins);
+            }
+        }
+        atomic_store_explicit(&next->locked, 0, memory_order_release);
+        break;
+    }
+    case LOCK_CLH:
+        atomic_store_explicit(&ctx->clh_mine->locked, 0, memory_order_release);
+        ctx->clh_mine = ctx->clh_pred; // recycle the predecessor's node
+        break;
+    case LOCK_FUTEX:
+        if (atomic_fetch_sub(&l->word, 1) != 1) {
+            atomic_store(&l->word, 0);
+            futex_wake(&l->word, 1);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+static void hist_add(struct hist *h, uint64_t ns) {
+    int b = ns ? 64 - __builtin_clzll(ns) : 0;
+    h->count[b < HIST_BUCKETS ? b : HIST_BUCKETS - 1]++;
+    h->n++;
+    h->sum += ns;
+    if (ns > h->max) h->max = ns;
+}
+
+static void hist_merge(struct hist *into, const struct hist *h) {
+    for (int b = 0; b < HIST_BUCKETS; ++b) into->count[b] += h->count[b];
+    into->n += h->n;
+    into->sum += h->sum;
+    if (h->max > into->max) into->max = h->max;
+}
+
+// upper bound of the bucket holding quantile q
+static uint64_t hist_quantile(const struct hist *h, double q) {
+    uint64_t want = (uint64_t)(q * (double)h->n), seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; ++b) {
+        seen += h->count[b];
+        if (seen > want) return b ? ((uint64_t)1 << b) - 1 : 0;
+    }
+    return h->max;
+}
+
+// time waiting for and holding each lock when -H asked for it
+static void lock_acquire(struct lock *l, struct lock_ctx *ctx) {
+    if (!ctx->wait) {
+        lock_acquire_raw(l, ctx);
+        return;
+    }
+    uint64_t t0 = now_ns();
+    lock_acquire_raw(l, ctx);
+    ctx->acquired = now_ns();
+    hist_add(ctx->wait, ctx->acquired - t0);
+}
+
+static void lock_release(struct lock *l, struct lock_ctx *ctx) {
+    if (ctx->hold) hist_add(ctx->hold, now_ns() - ctx->acquired);
+    lock_release_raw(l, ctx);
+}
+
+static void init_locks(void) {
+    lock_init(&table_lock);
+    for (int i = 0; i < C; ++i) {
+        lock_init(&coin_locks[i]);
+        lock_init(&padded_locks[i].lock);
+    }
+}
+
+static void destroy_locks(void) {
+    lock_destroy(&table_lock);
+    for (int i = 0; i < C; ++i) {
+        lock_destroy(&coin_locks[i]);
+        lock_destroy(&padded_locks[i].lock);
+    }
+}
+
+static void *alloc_lines(size_t size) {
+    size = (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    void *p = aligned_alloc(CACHE_LINE, size);
+    if (!p) {
+        perror("aligned_alloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+// all per-coin tables, sized for C coins
+static void alloc_tables(void) {
+    coins = alloc_lines((size_t)C + 1);
+    start_coins = alloc_lines((size_t)C + 1);
+    coin_locks = alloc_lines(sizeof(struct lock) * C);
+    padded_locks = alloc_lines(sizeof(struct padded_lock_coin) * C);
+    padded_coins = alloc_lines(sizeof(struct padded_coin) * C);
+    shard_stride = ((size_t)C + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    shards = alloc_lines(shard_stride * P);
+}
+
+static void free_tables(void) {
+    free(coins);
+    free(start_coins);
+    free(coin_locks);
+    free(padded_locks);
+    free(padded_coins);
+    free(shards);
+}
 
 // initialize coins
 static void init_coins(void) {
-    for (int i = 0; i < COIN_COUNT; ++i) {
-        if (i < COIN_COUNT/2) {
+    for (int i = 0; i < C; ++i) {
+        if (i < C/2) {
             coins[i] = '0';
         } else coins[i] = 'X';
     }
-    coins[COIN_COUNT] = '\0';
+    coins[C] = '\0';
 }
 
 // print coins
@@ -40,19 +391,32 @@ static void flip_coin_index(int i) {
     coins[i] = (coins[i] == '0') ? 'X' : '0';
 }
 
+/* Every coin is flipped P*N times by every strategy, so the end state is
+   the start state when P*N is even and its complement when odd. Any
+   other outcome means flips were lost. */
+static int check_coins(void) {
+    int odd = ((long long)P * N) % 2 != 0;
+    for (int i = 0; i < C; ++i) {
+        char want = start_coins[i];
+        if (odd) want = (want == '0') ? 'X' : '0';
+        if (coins[i] != want) return 0;
+    }
+    return 1;
+}
+
 /* Strategy 1:
    Each thread acquires the global (table) lock once,
    flips ALL 20 coins N times, then releases the lock.
 */
 static void *global_lock_all(void *arg) {
-    (void)arg;
-    pthread_mutex_lock(&table_lock);
+    struct lock_ctx *ctx = arg;
+    lock_acquire(&table_lock, ctx);
     for (int i = 0; i < N; ++i) {
-        for (int j = 0; j < COIN_COUNT; ++j) {
+        for (int j = 0; j < C; ++j) {
             flip_coin_index(j);
         }
     }
-    pthread_mutex_unlock(&table_lock);
+    lock_release(&table_lock, ctx);
     return NULL;
 }
 
@@ -61,13 +425,13 @@ static void *global_lock_all(void *arg) {
    flip all coins once, release.
 */
 static void *global_lock_iter(void *arg) {
-    (void)arg;
+    struct lock_ctx *ctx = arg;
     for (int iter = 0; iter < N; ++iter) {
-        pthread_mutex_lock(&table_lock);
-        for (int j = 0; j < COIN_COUNT; ++j) {
+        lock_acquire(&table_lock, ctx);
+        for (int j = 0; j < C; ++j) {
             flip_coin_index(j);
         }
-        pthread_mutex_unlock(&table_lock);
+        lock_release(&table_lock, ctx);
     }
     return NULL;
 }
@@ -77,105 +441,773 @@ static void *global_lock_iter(void *arg) {
    flips the coin, then unlocks.
 */
 static void *sep_coin_lock(void *arg) {
+    struct lock_ctx *ctx = arg;
+    for (int iter = 0; iter < N; ++iter) {
+        for (int j = 0; j < C; ++j) {
+            lock_acquire(&coin_locks[j], ctx);
+            flip_coin_index(j);
+            lock_release(&coin_locks[j], ctx);
+        }
+    }
+    return NULL;
+}
+
+/* Strategy 4:
+   All coins packed into one word; each thread loops N times and flips
+   the whole table with a single atomic fetch_xor.
+*/
+static void *atomic_word_xor(void *arg) {
     (void)arg;
+    const uint64_t all = (C == 64) ? UINT64_MAX : ((uint64_t)1 << C) - 1;
     for (int iter = 0; iter < N; ++iter) {
-        for (int j = 0; j < COIN_COUNT; ++j) {
-            pthread_mutex_lock(&coin_locks[j]);
+        atomic_fetch_xor_explicit(&coin_word, all, memory_order_relaxed);
+    }
+    return NULL;
+}
+
+/* Strategy 5:
+   Each thread loops N times; every coin is its own cache-line-padded
+   byte and is flipped with an atomic fetch_xor, no lock at all.
+*/
+static void *atomic_coin_xor(void *arg) {
+    (void)arg;
+    for (int iter = 0; iter < N; ++iter) {
+        for (int j = 0; j < C; ++j) {
+            atomic_fetch_xor_explicit(&padded_coins[j].v, 1, memory_order_relaxed);
+        }
+    }
+    return NULL;
+}
+
+// coins[] <-> the lock-free representations, around a run
+static void word_load(void) {
+    uint64_t w = 0;
+    for (int i = 0; i < C; ++i) {
+        if (coins[i] == 'X') w |= (uint64_t)1 << i;
+    }
+    atomic_store(&coin_word, w);
+}
+
+static void word_store(void) {
+    uint64_t w = atomic_load(&coin_word);
+    for (int i = 0; i < C; ++i) {
+        coins[i] = (w >> i) & 1 ? 'X' : '0';
+    }
+}
+
+static void padded_load(void) {
+    for (int i = 0; i < C; ++i) {
+        atomic_store(&padded_coins[i].v, coins[i] == 'X');
+    }
+}
+
+static void padded_store(void) {
+    for (int i = 0; i < C; ++i) {
+        coins[i] = atomic_load(&padded_coins[i].v) ? 'X' : '0';
+    }
+}
+
+/* Flat combining: persons never touch coins[] themselves. Each posts a
+   "flip the table once" request in its own cache-line slot; whoever
+   gets table_lock serves every pending request in one pass, so the
+   table stays in the combiner's cache and most persons never take the
+   lock at all because someone else served them. */
+struct fc_slot {
+    _Alignas(CACHE_LINE) atomic_int pending;
+};
+static struct fc_slot *fc_slots; // one per person
+static unsigned long fc_passes, fc_served; // under table_lock
+
+static void fc_combine(void) {
+    fc_passes++;
+    for (int i = 0; i < P; ++i) {
+        if (!atomic_load_explicit(&fc_slots[i].pending, memory_order_acquire)) continue;
+        for (int j = 0; j < C; ++j) {
             flip_coin_index(j);
-            pthread_mutex_unlock(&coin_locks[j]);
+        }
+        atomic_store_explicit(&fc_slots[i].pending, 0, memory_order_release);
+        fc_served++;
+    }
+}
+
+/* Strategy 6:
+   Each thread loops N times: post a request, wait briefly for a
+   combiner to serve it, otherwise take the lock and combine.
+*/
+static void *flat_combining(void *arg) {
+    struct lock_ctx *ctx = arg;
+    struct fc_slot *mine = &fc_slots[ctx->id];
+    for (int iter = 0; iter < N; ++iter) {
+        atomic_store_explicit(&mine->pending, 1, memory_order_release);
+        int spins = 0;
+        while (atomic_load_explicit(&mine->pending, memory_order_acquire)) {
+            if (++spins < FC_SPINS) {
+                cpu_relax();
+                continue;
+            }
+            lock_acquire(&table_lock, ctx);
+            if (atomic_load_explicit(&mine->pending, memory_order_acquire)) {
+                fc_combine();
+            }
+            lock_release(&table_lock, ctx);
         }
     }
     return NULL;
 }
 
-// run n threads executing proc and join them
-static void run_threads(int n, void *(*proc)(void *)) {
-    pthread_t *threads = malloc(sizeof(pthread_t) * n); //array
-    if (!threads) {
-        perror("malloc");
+static void fc_load(void) {
+    for (int i = 0; i < P; ++i) {
+        atomic_store(&fc_slots[i].pending, 0);
+    }
+    fc_passes = fc_served = 0;
+}
+
+static void fc_report(void) {
+    printf("combining: %lu passes, %.1f requests per pass\n", fc_passes,
+           fc_passes ? (double)fc_served / (double)fc_passes : 0.0);
+}
+
+/* Strategy 7:
+   Like the coin lock, but every lock shares its cache line only with
+   its own coin, so the per-coin locks no longer false-share.
+*/
+static void *padded_coin_lock(void *arg) {
+    struct lock_ctx *ctx = arg;
+    for (int iter = 0; iter < N; ++iter) {
+        for (int j = 0; j < C; ++j) {
+            lock_acquire(&padded_locks[j].lock, ctx);
+            padded_locks[j].coin = (padded_locks[j].coin == '0') ? 'X' : '0';
+            lock_release(&padded_locks[j].lock, ctx);
+        }
+    }
+    return NULL;
+}
+
+static void padded_lock_load(void) {
+    for (int i = 0; i < C; ++i) {
+        padded_locks[i].coin = coins[i];
+    }
+}
+
+static void padded_lock_store(void) {
+    for (int i = 0; i < C; ++i) {
+        coins[i] = padded_locks[i].coin;
+    }
+}
+
+/* Strategy 8:
+   Sharded: every person flips only its own private row of coin deltas
+   and the rows are XORed into the table once everyone is done. Nothing
+   is shared while flipping, the bound for what coherence costs.
+*/
+static void *sharded_xor(void *arg) {
+    struct lock_ctx *ctx = arg;
+    char *mine = &shards[(size_t)ctx->id * shard_stride];
+    for (int iter = 0; iter < N; ++iter) {
+        for (int j = 0; j < C; ++j) {
+            mine[j] ^= 1;
+        }
+    }
+    return NULL;
+}
+
+static void shard_load(void) {
+    memset(shards, 0, shard_stride * P);
+}
+
+static void shard_store(void) {
+    for (int p = 0; p < P; ++p) {
+        const char *row = &shards[(size_t)p * shard_stride];
+        for (int j = 0; j < C; ++j) {
+            if (row[j]) flip_coin_index(j);
+        }
+    }
+}
+
+struct strategy {
+    const char *tag;          // label for the coin printouts
+    void *(*proc)(void *);    // what every person runs
+    void (*load)(void);       // coins[] into the strategy's own table, or NULL
+    void (*store)(void);      // and back, so the end state can be checked
+    int locked;               // runs once per selected lock implementation
+    void (*report)(void);     // strategy-specific numbers after a trial, or NULL
+    int max_coins;            // largest table it can hold, 0 = any
+};
+
+static const struct strategy strategies[] = {
+    { "global lock",    global_lock_all,  NULL,        NULL,         1, NULL,      0 },
+    { "iteration lock", global_lock_iter, NULL,        NULL,         1, NULL,      0 },
+    { "coin lock",      sep_coin_lock,    NULL,        NULL,         1, NULL,      0 },
+    { "atomic word",    atomic_word_xor,  word_load,   word_store,   0, NULL,      WORD_COINS },
+    { "atomic coin",    atomic_coin_xor,  padded_load, padded_store, 0, NULL,      0 },
+    { "flat combining", flat_combining,   fc_load,     NULL,         1, fc_report, 0 },
+    { "padded lock",    padded_coin_lock, padded_lock_load, padded_lock_store, 1, NULL, 0 },
+    { "sharded",        sharded_xor,      shard_load,  shard_store,  0, NULL,      0 },
+};
+#define NSTRATEGIES ((int)(sizeof(strategies) / sizeof(strategies[0])))
+
+/* Concurrent readers. Writers flip the whole table once per iteration,
+   as in the iteration lock strategy, while S reader threads keep taking
+   snapshots of all coins. Since every write flips every coin, a
+   consistent snapshot is always the start table or its complement;
+   anything else is a torn read. */
+enum snap_kind { SNAP_NONE, SNAP_SEQLOCK, SNAP_RCU, SNAP_RWLOCK, NSNAPS };
+static const char *snap_names[NSNAPS] = { "none", "seqlock", "rcu", "rwlock" };
+static enum snap_kind snap_kind;
+
+static atomic_uint seq; // seqlock: odd while a writer is inside
+
+/* rcu: readers use table cur. Every writer owns one spare copy: under
+   the lock it fills the spare from cur and publishes it, then after
+   releasing the lock waits out the readers of the copy it replaced,
+   which becomes its next spare. P writers need P + 1 copies, and no
+   writer ever waits for readers while holding the lock. */
+struct rcu_table {
+    _Alignas(CACHE_LINE) atomic_int readers; // readers still inside this copy
+    atomic_int waiting;                      // its writer sleeps on readers
+    char *coins;
+};
+static struct rcu_table *rcu;
+static atomic_int rcu_cur;
+
+static pthread_rwlock_t table_rwlock;
+
+static atomic_int readers_stop;
+static atomic_ullong snapshots, torn;
+
+// seqlock: coins[] is read while written, so both sides use atomic accesses
+static void *seqlock_writer(void *arg) {
+    struct lock_ctx *ctx = arg;
+    for (int iter = 0; iter < N; ++iter) {
+        lock_acquire(&table_lock, ctx);
+        unsigned s = atomic_load_explicit(&seq, memory_order_relaxed);
+        atomic_store_explicit(&seq, s + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        for (int j = 0; j < C; ++j) {
+            char c = __atomic_load_n(&coins[j], __ATOMIC_RELAXED);
+            __atomic_store_n(&coins[j], c == '0' ? 'X' : '0', __ATOMIC_RELAXED);
+        }
+        atomic_store_explicit(&seq, s + 2, memory_order_release);
+        lock_release(&table_lock, ctx);
+    }
+    return NULL;
+}
+
+static void seqlock_read(char *snap) {
+    unsigned s1, s2;
+    do {
+        while ((s1 = atomic_load_explicit(&seq, memory_order_acquire)) & 1) {
+            cpu_relax();
+        }
+        for (int j = 0; j < C; ++j) {
+            snap[j] = __atomic_load_n(&coins[j], __ATOMIC_RELAXED);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        s2 = atomic_load_explicit(&seq, memory_order_relaxed);
+    } while (s1 != s2);
+}
+
+static void *rcu_writer(void *arg) {
+    struct lock_ctx *ctx = arg;
+    int spare = ctx->id + 1; // copy 0 is the first cur
+    for (int iter = 0; iter < N; ++iter) {
+        lock_acquire(&table_lock, ctx);
+        int cur = atomic_load(&rcu_cur);
+        for (int j = 0; j < C; ++j) {
+            rcu[spare].coins[j] = rcu[cur].coins[j] == '0' ? 'X' : '0';
+        }
+        atomic_store(&rcu_cur, spare); // publish
+        lock_release(&table_lock, ctx);
+
+        // grace period, outside the lock: spin briefly, then sleep until
+        // the last reader of the old copy leaves
+        struct rcu_table *old = &rcu[cur];
+        int n, spins = 0;
+        while ((n = atomic_load(&old->readers)) != 0) {
+            if (spins++ < SPIN_LIMIT) {
+                cpu_relax();
+                continue;
+            }
+            atomic_store(&old->waiting, 1);
+            if ((n = atomic_load(&old->readers)) != 0) futex_wait(&old->readers, n);
+        }
+        atomic_store(&old->waiting, 0);
+        spare = cur;
+    }
+    return NULL;
+}
+
+// the last reader out of a retired copy wakes its writer
+static void rcu_unpin(int i) {
+    if (atomic_fetch_sub(&rcu[i].readers, 1) == 1 && atomic_load(&rcu[i].waiting)) {
+        futex_wake(&rcu[i].readers, 1);
+    }
+}
+
+static void rcu_read(char *snap) {
+    int cur;
+    for (;;) {
+        cur = atomic_load(&rcu_cur);
+        atomic_fetch_add(&rcu[cur].readers, 1);
+        if (atomic_load(&rcu_cur) == cur) break; // still current: pinned
+        rcu_unpin(cur);
+    }
+    memcpy(snap, rcu[cur].coins, C);
+    rcu_unpin(cur);
+}
+
+static void rcu_load(void) {
+    rcu = alloc_lines(sizeof(*rcu) * ((size_t)P + 1));
+    for (int i = 0; i <= P; ++i) {
+        rcu[i].coins = alloc_lines((size_t)C);
+    }
+    memcpy(rcu[0].coins, coins, C);
+    atomic_store(&rcu_cur, 0);
+}
+
+static void rcu_store(void) {
+    memcpy(coins, rcu[atomic_load(&rcu_cur)].coins, C);
+    for (int i = 0; i <= P; ++i) {
+        free(rcu[i].coins);
+    }
+    free(rcu);
+    rcu = NULL;
+}
+
+static void *rwlock_writer(void *arg) {
+    (void)arg;
+    for (int iter = 0; iter < N; ++iter) {
+        pthread_rwlock_wrlock(&table_rwlock);
+        for (int j = 0; j < C; ++j) {
+            flip_coin_index(j);
+        }
+        pthread_rwlock_unlock(&table_rwlock);
+    }
+    return NULL;
+}
+
+static void rwlock_read(char *snap) {
+    pthread_rwlock_rdlock(&table_rwlock);
+    memcpy(snap, coins, C);
+    pthread_rwlock_unlock(&table_rwlock);
+}
+
+static void *snap_reader(void *arg) {
+    pthread_barrier_t *ready = arg;
+    char *snap = alloc_lines((size_t)C), *inverse = alloc_lines((size_t)C);
+    unsigned long long n = 0, bad = 0;
+
+    for (int j = 0; j < C; ++j) {
+        inverse[j] = start_coins[j] == '0' ? 'X' : '0';
+    }
+    pthread_barrier_wait(ready);
+    while (!atomic_load_explicit(&readers_stop, memory_order_relaxed)) {
+        switch (snap_kind) {
+        case SNAP_SEQLOCK: seqlock_read(snap); break;
+        case SNAP_RCU:     rcu_read(snap); break;
+        case SNAP_RWLOCK:  rwlock_read(snap); break;
+        default:           break;
+        }
+        if (memcmp(snap, start_coins, C) != 0
+            && memcmp(snap, inverse, C) != 0) {
+            bad++;
+        }
+        n++;
+    }
+    atomic_fetch_add(&snapshots, n);
+    atomic_fetch_add(&torn, bad);
+    free(snap);
+    free(inverse);
+    return NULL;
+}
+
+/* Persistent pool of P persons. Every trial releases all of them at
+   once through the start barrier, so nobody runs uncontended while the
+   others are still being created, and the same threads are reused for
+   every strategy, lock and trial. */
+struct person {
+    _Alignas(CACHE_LINE) pthread_t tid;
+    struct lock_ctx ctx;
+    struct hist wait, hold;
+    double cpu_ms, sys_ms;    // this person's CPU time in the last trial
+    long nvcsw, nivcsw;       // and its voluntary/involuntary switches
+};
+
+static struct {
+    struct person *people;
+    pthread_barrier_t start, done; // P persons + the main thread
+    void *(*proc)(void *);
+    int quit;
+} pool;
+
+static double tv_ms(struct timeval a, struct timeval b) {
+    return (double)(b.tv_sec - a.tv_sec) * 1000.0 + (double)(b.tv_usec - a.tv_usec) / 1000.0;
+}
+
+static void *person_main(void *arg) {
+    struct person *me = arg;
+    for (;;) {
+        pthread_barrier_wait(&pool.start);
+        if (pool.quit) break;
+        struct rusage r0, r1;
+        struct timespec c0, c1;
+        getrusage(RUSAGE_THREAD, &r0);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c0);
+        pool.proc(&me->ctx);
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &c1);
+        getrusage(RUSAGE_THREAD, &r1);
+        // the thread clock is exact; rusage only splits off the kernel part
+        me->cpu_ms = (double)(c1.tv_sec - c0.tv_sec) * 1000.0
+                     + (double)(c1.tv_nsec - c0.tv_nsec) / 1e6;
+        me->sys_ms = tv_ms(r0.ru_stime, r1.ru_stime);
+        me->nvcsw = r1.ru_nvcsw - r0.ru_nvcsw;
+        me->nivcsw = r1.ru_nivcsw - r0.ru_nivcsw;
+        pthread_barrier_wait(&pool.done);
+    }
+    return NULL;
+}
+
+static void pool_start(void) {
+    pool.people = aligned_alloc(CACHE_LINE, sizeof(struct person) * P);
+    if (!pool.people) {
+        perror("aligned_alloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(pool.people, 0, sizeof(struct person) * P);
+    fc_slots = aligned_alloc(CACHE_LINE, sizeof(struct fc_slot) * P);
+    if (!fc_slots) {
+        perror("aligned_alloc");
         exit(EXIT_FAILURE);
     }
-    for (int i = 0; i < n; ++i) {
-        int rc = pthread_create(&threads[i], NULL, proc, NULL);
+    pthread_barrier_init(&pool.start, NULL, P + 1);
+    pthread_barrier_init(&pool.done, NULL, P + 1);
+    for (int i = 0; i < P; ++i) {
+        struct person *p = &pool.people[i];
+        p->ctx.clh_mine = clh_node_new();
+        p->ctx.id = i;
+        if (H) {
+            p->ctx.wait = &p->wait;
+            p->ctx.hold = &p->hold;
+        }
+        int rc = pthread_create(&p->tid, NULL, person_main, p);
         if (rc != 0) {
             fprintf(stderr, "pthread_create failed: %d\n", rc);
             exit(EXIT_FAILURE);
         }
     }
-    for (int i = 0; i < n; ++i) {
+}
+
+static void pool_stop(void) {
+    pool.quit = 1;
+    pthread_barrier_wait(&pool.start);
+    for (int i = 0; i < P; ++i) {
         //blocks until thread terminates
-        pthread_join(threads[i], NULL);
-    } 
-    free(threads);
+        pthread_join(pool.people[i].tid, NULL);
+        free(pool.people[i].ctx.clh_mine);
+    }
+    pthread_barrier_destroy(&pool.start);
+    pthread_barrier_destroy(&pool.done);
+    free(pool.people);
+    free(fc_slots);
 }
 
-// defined timeit function
-static double timeit(int n, void *(*proc)(void *)) {
-    clock_t t1, t2;
-    t1 = clock();
-    run_threads(n, proc);
-    t2 = clock();
-    return ((double)(t2 - t1)) / (double)CLOCKS_PER_SEC * 1000.0;
+// one trial of proc on every person; wall-clock ms from release to last finish
+static double timeit(void *(*proc)(void *)) {
+    pool.proc = proc;
+    uint64_t t1 = now_ns();
+    pthread_barrier_wait(&pool.start);
+    pthread_barrier_wait(&pool.done);
+    uint64_t t2 = now_ns();
+    return (double)(t2 - t1) / 1e6;
+}
+
+static void fmt_ns(char *buf, size_t len, uint64_t ns) {
+    if (ns < 1000) snprintf(buf, len, "%lluns", (unsigned long long)ns);
+    else if (ns < 1000000) snprintf(buf, len, "%.1fus", (double)ns / 1e3);
+    else snprintf(buf, len, "%.1fms", (double)ns / 1e6);
+}
+
+static void print_hist(const char *what, const struct hist *h) {
+    char p50[16], p99[16], max[16], mean[16], lo[16], hi[16];
+    if (h->n == 0) return;
+    fmt_ns(p50, sizeof(p50), hist_quantile(h, 0.50));
+    fmt_ns(p99, sizeof(p99), hist_quantile(h, 0.99));
+    fmt_ns(max, sizeof(max), h->max);
+    fmt_ns(mean, sizeof(mean), h->sum / h->n);
+    printf("  %s: n=%llu mean %s p50 <=%s p99 <=%s max %s\n", what,
+           (unsigned long long)h->n, mean, p50, p99, max);
+    for (int b = 0; b < HIST_BUCKETS; ++b) {
+        if (!h->count[b]) continue;
+        double pct = 100.0 * (double)h->count[b] / (double)h->n;
+        fmt_ns(lo, sizeof(lo), b ? (uint64_t)1 << (b - 1) : 0);
+        fmt_ns(hi, sizeof(hi), ((uint64_t)1 << b));
+        printf("    %7s - %-7s %10llu %5.1f%% ", lo, hi, (unsigned long long)h->count[b], pct);
+        for (int k = 0; k < (int)(pct / 2.0); ++k) putchar('#');
+        printf("\n");
+    }
+}
+
+/* R trials of one strategy under the current lock kind; prints the
+   timings and, with -H, the merged wait/hold histograms. Returns the
+   mean wall ms and clears *ok if any trial lost flips. */
+static double run_strategy(const struct strategy *st, const char *name, int *ok) {
+    char tag[64];
+    double sum = 0, best = 0;
+
+    for (int i = 0; i < P; ++i) {
+        memset(&pool.people[i].wait, 0, sizeof(struct hist));
+        memset(&pool.people[i].hold, 0, sizeof(struct hist));
+    }
+    for (int r = 0; r < R; ++r) {
+        init_coins();
+        memcpy(start_coins, coins, (size_t)C + 1);
+        if (r == 0) {
+            snprintf(tag, sizeof(tag), "start - %s", name);
+            print_coins(tag);
+        }
+        init_locks();
+        if (st->load) st->load();
+        double ms = timeit(st->proc);
+        if (st->store) st->store();
+        destroy_locks();
+
+        double cpu = 0, sys = 0, cpu_max = 0;
+        long vcs = 0, ivcs = 0;
+        for (int i = 0; i < P; ++i) {
+            const struct person *p = &pool.people[i];
+            cpu += p->cpu_ms;
+            sys += p->sys_ms;
+            if (p->cpu_ms > cpu_max) cpu_max = p->cpu_ms;
+            vcs += p->nvcsw;
+            ivcs += p->nivcsw;
+        }
+        if (r == R - 1) {
+            snprintf(tag, sizeof(tag), "end - %s", name);
+            print_coins(tag);
+        }
+        double flips = (double)P * N * C;
+        printf("%d threads x %d flips: %.3f ms wall, %.0f coin flips/s, cpu %.3f ms"
+               " (%.3f ms sys, max thread %.3f ms), %ld voluntary / %ld involuntary switches\n",
+               P, N, ms, ms > 0 ? flips / (ms / 1000.0) : 0, cpu, sys, cpu_max, vcs, ivcs);
+        if (st->report) st->report();
+        if (!check_coins()) {
+            printf("end state wrong: flips were lost\n");
+            *ok = 0;
+        }
+        sum += ms;
+        if (r == 0 || ms < best) best = ms;
+    }
+    if (R > 1) {
+        printf("%d trials: mean %.3f ms, best %.3f ms\n", R, sum / R, best);
+    }
+    if (H && st->locked) {
+        struct hist wait = { 0 }, hold = { 0 };
+        for (int i = 0; i < P; ++i) {
+            hist_merge(&wait, &pool.people[i].wait);
+            hist_merge(&hold, &pool.people[i].hold);
+        }
+        print_hist("lock wait", &wait);
+        print_hist("lock hold", &hold);
+    }
+    printf("\n");
+    return sum / R;
+}
+
+/* Writers on the pool, S readers on their own threads, once per snapshot
+   kind; "none" is the writers alone, the baseline for the slowdown. */
+static void run_readers(int *ok) {
+    static void *(*const writers[NSNAPS])(void *) = {
+        global_lock_iter, seqlock_writer, rcu_writer, rwlock_writer
+    };
+    double base = 0;
+    pthread_t *tids = malloc(sizeof(pthread_t) * S);
+    if (!tids) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%d readers vs %d writers x %d flips [%s]\n", S, P, N, lock_names[lock_kind]);
+    printf("%-8s %12s %14s %9s %14s %8s\n",
+           "snapshot", "writer ms", "writer flips/s", "slowdown", "snapshots/s", "torn");
+    for (int k = 0; k < NSNAPS; ++k) {
+        pthread_barrier_t ready;
+        int nreaders = k == SNAP_NONE ? 0 : S;
+
+        snap_kind = (enum snap_kind)k;
+        init_coins();
+        memcpy(start_coins, coins, (size_t)C + 1);
+        init_locks();
+        atomic_store(&seq, 0);
+        if (k == SNAP_RCU) rcu_load();
+        if (k == SNAP_RWLOCK) {
+            // glibc prefers readers by default, which starves the writers
+            pthread_rwlockattr_t attr;
+            pthread_rwlockattr_init(&attr);
+            pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+            pthread_rwlock_init(&table_rwlock, &attr);
+            pthread_rwlockattr_destroy(&attr);
+        }
+        atomic_store(&readers_stop, 0);
+        atomic_store(&snapshots, 0);
+        atomic_store(&torn, 0);
+
+        // readers are already reading when the writers are released
+        pthread_barrier_init(&ready, NULL, nreaders + 1);
+        for (int i = 0; i < nreaders; ++i) {
+            int rc = pthread_create(&tids[i], NULL, snap_reader, &ready);
+            if (rc != 0) {
+                fprintf(stderr, "pthread_create failed: %d\n", rc);
+                exit(EXIT_FAILURE);
+            }
+        }
+        pthread_barrier_wait(&ready);
+        double ms = timeit(writers[k]);
+        atomic_store(&readers_stop, 1);
+        for (int i = 0; i < nreaders; ++i) {
+            pthread_join(tids[i], NULL);
+        }
+        pthread_barrier_destroy(&ready);
+
+        if (k == SNAP_RCU) rcu_store();
+        if (k == SNAP_RWLOCK) pthread_rwlock_destroy(&table_rwlock);
+        destroy_locks();
+        if (k == SNAP_NONE) base = ms;
+
+        double flips = (double)P * N * C;
+        unsigned long long nt = atomic_load(&torn);
+        printf("%-8s %12.3f %14.0f %8.2fx %14.0f %8llu\n", snap_names[k], ms,
+               ms > 0 ? flips / (ms / 1000.0) : 0, base > 0 ? ms / base : 0,
+               ms > 0 ? (double)atomic_load(&snapshots) / (ms / 1000.0) : 0, nt);
+        if (nt || !check_coins()) {
+            printf("end state wrong or torn snapshots\n");
+            *ok = 0;
+        }
+    }
+    printf("\n");
+    free(tids);
 }
 
 static void usage(const char *prog) {
-    fprintf(stderr, "Usage: %s [-p threads] [-n flips]\n", prog);
+    fprintf(stderr, "Usage: %s [-p threads] [-n flips] [-C coins] [-L lock] [-r trials] [-H] [-s readers]\n", prog);
     fprintf(stderr, "  -p threads   number of persons/threads (default 100)\n");
     fprintf(stderr, "  -n flips     number of flips per person (default 10000)\n");
+    fprintf(stderr, "  -C coins     number of coins on the table (default 20)\n");
+    fprintf(stderr, "  -L lock      mutex, ttas, ticket, mcs, clh, futex or all (default mutex)\n");
+    fprintf(stderr, "  -r trials    runs of each strategy, all on the same threads (default 1)\n");
+    fprintf(stderr, "  -H           histograms of lock wait and hold times\n");
+    fprintf(stderr, "  -s readers   also compare seqlock, rcu and rwlock snapshots taken\n"
+                    "               by this many readers while the table is flipped\n");
     exit(EXIT_FAILURE);
 }
 
 int main(int argc, char **argv) {
     int opt;
-    while ((opt = getopt(argc, argv, "p:n:h")) != -1) {
+    int use_lock[NLOCKS] = { [LOCK_MUTEX] = 1 };
+    while ((opt = getopt(argc, argv, "p:n:C:L:r:Hs:h")) != -1) {
         switch (opt) {
             case 'p': 
                 P = atoi(optarg); 
                 if (P <= 0) {
                     usage(argv[0]); 
-                    break;
                 }
+                break;
             case 'n': 
                 N = atoi(optarg); 
                 if (N < 0) {
-                    usage(argv[0]); break;
+                    usage(argv[0]);
                 }
+                break;
+            case 'C':
+                C = atoi(optarg);
+                if (C <= 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'L': {
+                int found = 0;
+                memset(use_lock, 0, sizeof(use_lock));
+                for (int k = 0; k < NLOCKS; ++k) {
+                    if (strcmp(optarg, "all") == 0 || strcmp(optarg, lock_names[k]) == 0) {
+                        use_lock[k] = found = 1;
+                    }
+                }
+                if (!found) {
+                    usage(argv[0]);
+                }
+                break;
+            }
+ 
+            case 'r':
+                R = atoi(optarg);
+                if (R <= 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'H':
+                H = 1;
+                break;
+            case 's':
+                S = atoi(optarg);
+                if (S < 0) {
+                    usage(argv[0]);
+                }
+                break;
             default: 
                 usage(argv[0]); 
                 break;
         }
     }
 
-    // initialize coin locks
-    for (int i = 0; i < COIN_COUNT; ++i) {
-        pthread_mutex_init(&coin_locks[i], NULL);
-    }
+    int ok = 1;
+    int nlocks = 0;
+    alloc_tables();
+    pool_start();
+    double ms[NSTRATEGIES][NLOCKS]; // the strategy x lock matrix, ms
+    for (int k = 0; k < NLOCKS; ++k) {
+        if (!use_lock[k]) continue;
+        lock_kind = (enum lock_kind)k;
+        for (int s = 0; s < NSTRATEGIES; ++s) {
+            const struct strategy *st = &strategies[s];
+            char name[48];
 
-    //Strategy 1: global lock for entire N
-    init_coins();
-    print_coins("start - global lock");
-    double t1_ms = timeit(P, global_lock_all);
-    print_coins("end - global lock");
-    printf("%d threads x %d flips: %.3f ms\n\n", P, N, t1_ms);
+            ms[s][k] = -1;
+            // lock-free strategies don't depend on the lock: run them once
+            if (!st->locked && nlocks > 0) continue;
+            if (st->max_coins && C > st->max_coins) {
+                if (nlocks == 0) printf("%s: skipped, holds at most %d coins\n\n", st->tag, st->max_coins);
+                continue;
+            }
 
-    // Strategy 2: global lock each iteration 
-    init_coins();
-    print_coins("start - iteration lock");
-    double t2_ms = timeit(P, global_lock_iter);
-    print_coins("end - iteration lock");
-    printf("%d threads x %d flips: %.3f ms\n\n", P, N, t2_ms);
+            if (st->locked) {
+                snprintf(name, sizeof(name), "%s [%s]", st->tag, lock_names[k]);
+            } else {
+                snprintf(name, sizeof(name), "%s", st->tag);
+            }
+            ms[s][k] = run_strategy(st, name, &ok);
+        }
+        if (S > 0) run_readers(&ok);
+        nlocks++;
+    }
 
-    // Strategy 3: per-coin locks
-    init_coins();
-    print_coins("start - coin lock");
-    double t3_ms = timeit(P, sep_coin_lock);
-    print_coins("end - coin lock");
-    printf("%d threads x %d flips: %.3f ms\n\n", P, N, t3_ms);
+    pool_stop();
+    free_tables();
 
-    // destroy coin locks
-    for (int i = 0; i < COIN_COUNT; ++i) {
-        pthread_mutex_destroy(&coin_locks[i]);
+    // with several locks, sum up the matrix
+    if (nlocks > 1) {
+        printf("%-16s", "wall ms");
+        for (int k = 0; k < NLOCKS; ++k) {
+            if (use_lock[k]) printf(" %10s", lock_names[k]);
+        }
+        printf("\n");
+        for (int s = 0; s < NSTRATEGIES; ++s) {
+            if (!strategies[s].locked) continue;
+            printf("%-16s", strategies[s].tag);
+            for (int k = 0; k < NLOCKS; ++k) {
+                if (use_lock[k]) printf(" %10.3f", ms[s][k]);
+            }
+            printf("\n");
+        }
     }
 
-    return 0;
+    return ok ? 0 : EXIT_FAILURE;
 }
@@ -16,8 +16,11 @@ Redon Jashari````
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdatomic.h>
+#include <stddef.h>
+#include <sched.h>
 
 #define BUFFER_SIZE 12
+#define CACHE_LINE 64
 
 typedef struct buffer {
     unsigned int    data[BUFFER_SIZE];
@@ -42,6 +45,27 @@ static buffer_t shared_buffer = {
     .mutex = PTHREAD_MUTEX_INITIALIZER
 };
 
+/* Lock-free bounded MPMC queue (Vyukov). Every cell carries a sequence
+   number: seq == pos means free for the producer holding ticket pos,
+   seq == pos + 1 means filled for the consumer holding ticket pos. A
+   consumer hands the cell on to ticket pos + BUFFER_SIZE. Tickets are
+   claimed with a CAS on enqueue_pos/dequeue_pos, so an item costs one
+   CAS and no lock or futex when the queue is neither full nor empty. */
+typedef struct mpmc_cell {
+    _Alignas(CACHE_LINE) atomic_size_t seq;
+    unsigned int data;
+} mpmc_cell_t;
+
+typedef struct mpmc {
+    _Alignas(CACHE_LINE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE) atomic_size_t dequeue_pos;
+    mpmc_cell_t cells[BUFFER_SIZE];
+} mpmc_t;
+
+static mpmc_t shared_mpmc;
+
+enum backend { BACKEND_MUTEX, BACKEND_MPMC };
+
 //initialize semaphores and checker 
 static void
 buffer_init(buffer_t *b)
@@ -53,6 +77,47 @@ buffer_init(buffer_t *b)
     }
 }
 
+static void
+mpmc_init(mpmc_t *q)
+{
+    for (size_t i = 0; i < BUFFER_SIZE; ++i) {
+        atomic_store_explicit(&q->cells[i].seq, i, memory_order_relaxed);
+        atomic_store_explicit(&checker[i], 0u, memory_order_relaxed);
+    }
+    atomic_store_explicit(&q->enqueue_pos, 0, memory_order_relaxed);
+    atomic_store_explicit(&q->dequeue_pos, 0, memory_order_relaxed);
+}
+
+// claim the next cell whose sequence is ticket + lag; yields while none is ready
+static mpmc_cell_t *
+mpmc_claim(mpmc_t *q, atomic_size_t *tickets, size_t lag, size_t *pos)
+{
+    size_t p = atomic_load_explicit(tickets, memory_order_relaxed);
+
+    while (1) {
+        mpmc_cell_t *cell = &q->cells[p % BUFFER_SIZE];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)(seq - (p + lag));
+
+        if (diff == 0) {
+            // cell is ours if no one else took this ticket meanwhile
+            if (atomic_compare_exchange_weak_explicit(tickets, &p, p + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                *pos = p;
+                return cell;
+            }
+        } else if (diff < 0) {
+            // full (producer) or empty (consumer): let the other side run
+            sched_yield();
+            p = atomic_load_explicit(tickets, memory_order_relaxed);
+        } else {
+            // another thread got this ticket first
+            p = atomic_load_explicit(tickets, memory_order_relaxed);
+        }
+    }
+}
+
 // produce returns a strictly increasing positive integer
 static unsigned int
 produce(void)
@@ -121,6 +186,7 @@ consumer(void *data)
 
         // if seen is zero, that would mean reader raced the writer
         unsigned int item = buffer->data[idx];
+        assert(seen == item);
 
         // clear the checker slot for future use
         atomic_store_explicit(&checker[idx], 0u, memory_order_relaxed);
@@ -138,17 +204,77 @@ consumer(void *data)
     return NULL;
 }
 
+//producer on the lock-free queue: claim a free cell, write item and publish
+static void*
+mpmc_producer(void *data)
+{
+    mpmc_t *q = (mpmc_t *) data;
+
+    while (1) {
+        unsigned int item = produce();
+        size_t pos;
+
+        mpmc_cell_t *cell = mpmc_claim(q, &q->enqueue_pos, 0, &pos);
+        int idx = (int)(pos % BUFFER_SIZE);
+        cell->data = item;
+
+        // publish the value for checkerboard
+        atomic_store_explicit(&checker[idx], item, memory_order_release);
+
+        // hand the cell to the consumer holding ticket pos
+        atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    }
+    return NULL;
+}
+
+// consumer on the lock-free queue: claim a filled cell, read and validate via checker
+static void*
+mpmc_consumer(void *data)
+{
+    mpmc_t *q = (mpmc_t *) data;
+
+    while (1) {
+        size_t pos;
+
+        mpmc_cell_t *cell = mpmc_claim(q, &q->dequeue_pos, 1, &pos);
+        int idx = (int)(pos % BUFFER_SIZE);
+
+        unsigned int seen = atomic_load_explicit(&checker[idx], memory_order_acquire);
+        unsigned int item = cell->data;
+        assert(seen == item);
+
+        // clear the checker slot for future use
+        atomic_store_explicit(&checker[idx], 0u, memory_order_relaxed);
+
+        // the cell is free again for the producer one lap later
+        atomic_store_explicit(&cell->seq, pos + BUFFER_SIZE, memory_order_release);
+
+        consume(item);
+    }
+    return NULL;
+}
+
 static int
-run(int nc, int np)
+run(int nc, int np, enum backend backend)
 {
     int err, n = nc + np;
     pthread_t thread[n];
-
-    buffer_init(&shared_buffer);
+    void *(*consumer_fn)(void *) = consumer;
+    void *(*producer_fn)(void *) = producer;
+    void *queue = &shared_buffer;
+
+    if (backend == BACKEND_MPMC) {
+        mpmc_init(&shared_mpmc);
+        consumer_fn = mpmc_consumer;
+        producer_fn = mpmc_producer;
+        queue = &shared_mpmc;
+    } else {
+        buffer_init(&shared_buffer);
+    }
 
     for (int i = 0; i < n; i++) {
         err = pthread_create(&thread[i], NULL,
-                             i < nc ? consumer : producer, &shared_buffer);
+                             i < nc ? consumer_fn : producer_fn, queue);
         if (err) {
             fprintf(stderr, "bounded: %s(): unable to create thread %d: %s\n",
                     __func__, i, strerror(err));
@@ -173,8 +299,9 @@ int
 main(int argc, char *argv[])
 {
     int c, nc = 1, np = 1;
+    enum backend backend = BACKEND_MUTEX;
 
-    while ((c = getopt(argc, argv, "c:p:h")) >= 0) {
+    while ((c = getopt(argc, argv, "c:p:b:h")) >= 0) {
         switch (c) {
         case 'c':
             if ((nc = atoi(optarg)) <= 0) {
@@ -188,11 +315,21 @@ main(int argc, char *argv[])
                 exit(EXIT_FAILURE);
             }
             break;
+        case 'b':
+            if (strcmp(optarg, "mutex") == 0) {
+                backend = BACKEND_MUTEX;
+            } else if (strcmp(optarg, "mpmc") == 0) {
+                backend = BACKEND_MPMC;
+            } else {
+                fprintf(stderr, "backend must be mutex or mpmc\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'h':
-            printf("Usage: %s [-c consumers] [-p producers] [-h]\n", argv[0]);
+            printf("Usage: %s [-c consumers] [-p producers] [-b mutex|mpmc] [-h]\n", argv[0]);
             exit(EXIT_SUCCESS);
         }
     }
 
-    return run(nc, np);
+    return run(nc, np, backend);
 }